@@ -0,0 +1,70 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// One record per object, written by IndirectRenderer::update(); must match IndirectObject
+struct Object {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint indexCount;
+    uint firstIndex;
+    int baseVertex;
+    int materialIndex;
+};
+
+// The layout glMultiDrawElementsIndirect reads
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+
+layout (std430, binding = 1) writeonly buffer Commands {
+    DrawCommand commands[];
+};
+
+// InstanceData as multiLight.vs reads it: the model matrix then the material index, 17 words each
+layout (std430, binding = 2) writeonly buffer Instances {
+    float instances[];
+};
+
+// Frustum planes with normals pointing inwards, as extractFrustum() gives them
+uniform vec4 planes[6];
+uniform int objectCount;
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= objectCount)
+        return;
+    Object object = objects[i];
+
+    // The box around the transformed box, as transformBounds() finds it on the CPU
+    vec3 center = 0.5 * (object.boundsMin.xyz + object.boundsMax.xyz);
+    vec3 extent = 0.5 * (object.boundsMax.xyz - object.boundsMin.xyz);
+    vec3 worldCenter = vec3(object.model * vec4(center, 1.0));
+    vec3 worldExtent = abs(object.model[0].xyz) * extent.x + abs(object.model[1].xyz) * extent.y + abs(object.model[2].xyz) * extent.z;
+
+    // Culled once the corner furthest along some plane's normal is still behind it
+    bool visible = true;
+    for (int p = 0; p < 6; p++) {
+        if (dot(planes[p].xyz, worldCenter) + dot(abs(planes[p].xyz), worldExtent) + planes[p].w < 0.0)
+            visible = false;
+    }
+
+    // Every object keeps its command; a culled one just draws no instances
+    commands[i] = DrawCommand(object.indexCount, visible ? 1u : 0u, object.firstIndex, object.baseVertex, uint(i));
+    if (visible) {
+        int base = i * 17;
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+                instances[base + column * 4 + row] = object.model[column][row];
+        instances[base + 16] = intBitsToFloat(object.materialIndex);
+    }
+}
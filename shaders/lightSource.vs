@@ -1,9 +1,14 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+// Per-frame camera data shared by every program, filled by FrameUniforms
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
@@ -1,11 +1,16 @@
 #version 330 core
 out vec4 FragColor;
 
+// Entry in the material table; the texture fields are texture units.
+// color is the object's base color, kept with the material instead of in every vertex.
+// opacity below 1 is blended over what is behind; such objects are drawn last, back to front.
 struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
+    vec3 color;
+    int diffuse;
+    int specular;
     float shininess;
-}; 
+    float opacity;
+};
 
 struct DirLight {
     vec3 direction;
@@ -43,18 +48,37 @@ struct SpotLight {
 };
 
 #define NR_POINT_LIGHTS 1
+#define MAX_MATERIALS 16
+#define MAX_TEXTURE_UNITS 8
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+flat in int MaterialIndex;
+
+// Per-frame camera and light data shared by every program, filled by FrameUniforms
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
-uniform Material material;
+uniform Material materials[MAX_MATERIALS];
+uniform sampler2D textureUnits[MAX_TEXTURE_UNITS];
+
+// surface properties of this fragment, looked up once in main()
+vec3 diffuseColor;
+vec3 specularColor;
+float shininess;
 
 // function prototypes
+vec3 SampleUnit(int unit, vec2 uv, vec2 dx, vec2 dy);
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
@@ -64,6 +88,13 @@ void main()
     // properties
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
+
+    // material: this object's entry in the material table
+    vec2 dx = dFdx(TexCoords);
+    vec2 dy = dFdy(TexCoords);
+    diffuseColor = SampleUnit(materials[MaterialIndex].diffuse, TexCoords, dx, dy);
+    specularColor = SampleUnit(materials[MaterialIndex].specular, TexCoords, dx, dy);
+    shininess = materials[MaterialIndex].shininess;
     
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
@@ -79,7 +110,22 @@ void main()
     // phase 3: spot light
     //result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
     
-    FragColor = vec4(result, 1.0);
+    FragColor = vec4(result, materials[MaterialIndex].opacity);
+}
+
+// samples the texture bound to the given unit; sampler arrays only accept constant indices
+vec3 SampleUnit(int unit, vec2 uv, vec2 dx, vec2 dy)
+{
+    switch (unit) {
+        case 0: return vec3(textureGrad(textureUnits[0], uv, dx, dy));
+        case 1: return vec3(textureGrad(textureUnits[1], uv, dx, dy));
+        case 2: return vec3(textureGrad(textureUnits[2], uv, dx, dy));
+        case 3: return vec3(textureGrad(textureUnits[3], uv, dx, dy));
+        case 4: return vec3(textureGrad(textureUnits[4], uv, dx, dy));
+        case 5: return vec3(textureGrad(textureUnits[5], uv, dx, dy));
+        case 6: return vec3(textureGrad(textureUnits[6], uv, dx, dy));
+        default: return vec3(textureGrad(textureUnits[7], uv, dx, dy));
+    }
 }
 
 // calculates the color when using a directional light.
@@ -90,11 +136,11 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     return (ambient + diffuse + specular);
 }
 
@@ -106,14 +152,14 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -128,7 +174,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
@@ -137,9 +183,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
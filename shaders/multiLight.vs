@@ -1,22 +1,47 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
+// location 1 used to hold the vertex color, which now comes from the material
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aNormal;
+layout (location = 4) in mat4 aInstanceModel; // per-instance, takes locations 4 to 7
+layout (location = 8) in int aInstanceMaterial;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out int MaterialIndex;
+
+// Per-frame camera data shared by every program, filled by FrameUniforms
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool instanced;
+uniform int materialIndex;
+uniform bool compactVertices;
+
+// compact vertices store the normal octahedral encoded in the first two components
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    // Instanced draws read the model matrix and material from the instance buffer
+    mat4 objectModel = instanced ? aInstanceModel : model;
+    MaterialIndex = instanced ? aInstanceMaterial : materialIndex;
+
+    FragPos = vec3(objectModel * vec4(aPos, 1.0));
+    vec3 normal = compactVertices ? OctDecode(aNormal.xy) : aNormal;
+    Normal = mat3(transpose(inverse(objectModel))) * normal;
     TexCoords = aTexCoords;
-    
+
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,172 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "simd.h"
+
+// An axis aligned box and a bounding sphere around the same geometry
+struct Bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;   // of the sphere, which is also the middle of the box
+    float radius;
+};
+
+// Bounds for a box, with a sphere of the given radius around its middle.
+// Generators know their shape, so they can pass a tighter radius than the box's half diagonal.
+Bounds boxBounds(const glm::vec3 &low, const glm::vec3 &high, float radius) {
+    Bounds bounds;
+    bounds.min = low;
+    bounds.max = high;
+    bounds.center = (low + high) * 0.5f;
+    bounds.radius = radius;
+    return bounds;
+}
+
+// Bounds of local geometry once the model matrix is applied. The box is the smallest
+// axis aligned box around the transformed box; the sphere grows by the largest axis scale.
+Bounds transformBounds(const glm::mat4 &model, const Bounds &local) {
+    glm::vec3 center = (local.min + local.max) * 0.5f;
+    glm::vec3 extent = (local.max - local.min) * 0.5f;
+    glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+    glm::vec3 worldExtent = glm::abs(glm::vec3(model[0])) * extent.x + glm::abs(glm::vec3(model[1])) * extent.y + glm::abs(glm::vec3(model[2])) * extent.z;
+    float scale = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])), std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+    Bounds world;
+    world.min = worldCenter - worldExtent;
+    world.max = worldCenter + worldExtent;
+    world.center = glm::vec3(model * glm::vec4(local.center, 1.0f));
+    world.radius = local.radius * std::sqrt(scale);
+    return world;
+}
+
+// World bounds for many objects at once. Fill models and local, then call transform();
+// the results are kept one array per component so later passes can test four objects per register.
+class BoundsBatch
+{
+    public:
+
+        // Size the inputs and results for count objects
+        void resize(int count);
+        int size();
+
+        // Transform every object's local bounds by its model matrix, four objects at a time
+        void transform();
+
+        // The results for one object
+        Bounds get(int i) const;
+
+        // Inputs
+        std::vector<glm::mat4> models;
+        std::vector<const Bounds*> local;
+
+        // Results
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+        std::vector<float> centerX, centerY, centerZ, radius;
+};
+
+void BoundsBatch::resize(int count) {
+    models.resize(count);
+    local.resize(count);
+    for (std::vector<float>* component : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ, &centerX, &centerY, &centerZ, &radius}) {
+        component->resize(count);
+    }
+}
+
+int BoundsBatch::size() {
+    return models.size();
+}
+
+void BoundsBatch::transform() {
+    int count = size();
+    int i = 0;
+#ifdef USE_SSE
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 signBits = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4) {
+        // Transpose each matrix column so m[column][row] holds that element for all four objects
+        __m128 m[4][3];
+        for (int column = 0; column < 4; column++) {
+            __m128 a = _mm_loadu_ps(&models[i][column][0]);
+            __m128 b = _mm_loadu_ps(&models[i + 1][column][0]);
+            __m128 c = _mm_loadu_ps(&models[i + 2][column][0]);
+            __m128 d = _mm_loadu_ps(&models[i + 3][column][0]);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            m[column][0] = a;
+            m[column][1] = b;
+            m[column][2] = c;
+        }
+        const Bounds* l0 = local[i];
+        const Bounds* l1 = local[i + 1];
+        const Bounds* l2 = local[i + 2];
+        const Bounds* l3 = local[i + 3];
+        __m128 lowX = _mm_setr_ps(l0->min.x, l1->min.x, l2->min.x, l3->min.x);
+        __m128 lowY = _mm_setr_ps(l0->min.y, l1->min.y, l2->min.y, l3->min.y);
+        __m128 lowZ = _mm_setr_ps(l0->min.z, l1->min.z, l2->min.z, l3->min.z);
+        __m128 highX = _mm_setr_ps(l0->max.x, l1->max.x, l2->max.x, l3->max.x);
+        __m128 highY = _mm_setr_ps(l0->max.y, l1->max.y, l2->max.y, l3->max.y);
+        __m128 highZ = _mm_setr_ps(l0->max.z, l1->max.z, l2->max.z, l3->max.z);
+        __m128 boxX = _mm_mul_ps(_mm_add_ps(lowX, highX), half);
+        __m128 boxY = _mm_mul_ps(_mm_add_ps(lowY, highY), half);
+        __m128 boxZ = _mm_mul_ps(_mm_add_ps(lowZ, highZ), half);
+        __m128 extentX = _mm_mul_ps(_mm_sub_ps(highX, lowX), half);
+        __m128 extentY = _mm_mul_ps(_mm_sub_ps(highY, lowY), half);
+        __m128 extentZ = _mm_mul_ps(_mm_sub_ps(highZ, lowZ), half);
+        __m128 sphereX = _mm_setr_ps(l0->center.x, l1->center.x, l2->center.x, l3->center.x);
+        __m128 sphereY = _mm_setr_ps(l0->center.y, l1->center.y, l2->center.y, l3->center.y);
+        __m128 sphereZ = _mm_setr_ps(l0->center.z, l1->center.z, l2->center.z, l3->center.z);
+        __m128 sphereRadius = _mm_setr_ps(l0->radius, l1->radius, l2->radius, l3->radius);
+
+        for (int row = 0; row < 3; row++) {
+            // Box: the centre is transformed as a point, the extent by the absolute matrix
+            __m128 center = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][row], boxX), _mm_mul_ps(m[1][row], boxY)), _mm_add_ps(_mm_mul_ps(m[2][row], boxZ), m[3][row]));
+            __m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signBits, m[0][row]), extentX), _mm_mul_ps(_mm_andnot_ps(signBits, m[1][row]), extentY)), _mm_mul_ps(_mm_andnot_ps(signBits, m[2][row]), extentZ));
+            __m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][row], sphereX), _mm_mul_ps(m[1][row], sphereY)), _mm_add_ps(_mm_mul_ps(m[2][row], sphereZ), m[3][row]));
+            float* low = row == 0 ? minX.data() : row == 1 ? minY.data() : minZ.data();
+            float* high = row == 0 ? maxX.data() : row == 1 ? maxY.data() : maxZ.data();
+            float* middle = row == 0 ? centerX.data() : row == 1 ? centerY.data() : centerZ.data();
+            _mm_storeu_ps(low + i, _mm_sub_ps(center, extent));
+            _mm_storeu_ps(high + i, _mm_add_ps(center, extent));
+            _mm_storeu_ps(middle + i, sphere);
+        }
+
+        // Squared length of each axis; the sphere grows by the longest
+        __m128 scale = _mm_setzero_ps();
+        for (int column = 0; column < 3; column++) {
+            __m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[column][0], m[column][0]), _mm_mul_ps(m[column][1], m[column][1])), _mm_mul_ps(m[column][2], m[column][2]));
+            scale = _mm_max_ps(scale, length);
+        }
+        _mm_storeu_ps(radius.data() + i, _mm_mul_ps(sphereRadius, _mm_sqrt_ps(scale)));
+    }
+#endif
+    for (; i < count; i++) {
+        Bounds world = transformBounds(models[i], *local[i]);
+        minX[i] = world.min.x;
+        minY[i] = world.min.y;
+        minZ[i] = world.min.z;
+        maxX[i] = world.max.x;
+        maxY[i] = world.max.y;
+        maxZ[i] = world.max.z;
+        centerX[i] = world.center.x;
+        centerY[i] = world.center.y;
+        centerZ[i] = world.center.z;
+        radius[i] = world.radius;
+    }
+}
+
+Bounds BoundsBatch::get(int i) const {
+    Bounds world;
+    world.min = glm::vec3(minX[i], minY[i], minZ[i]);
+    world.max = glm::vec3(maxX[i], maxY[i], maxZ[i]);
+    world.center = glm::vec3(centerX[i], centerY[i], centerZ[i]);
+    world.radius = radius[i];
+    return world;
+}
+#endif
@@ -0,0 +1,531 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "simd.h"
+
+// Bins per axis when looking for the cheapest split, and the most objects a leaf may hold
+const int BVH_BINS = 16;
+const int BVH_MAX_LEAF_SIZE = 4;
+
+// Cost of visiting a node, relative to testing one object
+const float BVH_TRAVERSAL_COST = 1.0f;
+
+// Nodes a query can hold waiting on the call stack; deeper trees, which skewed inputs can build, use the heap
+const int BVH_STACK_SIZE = 128;
+
+// A box in the 32 byte layout every hierarchy node uses, so two fit in a cache line and the
+// corners load straight into SSE registers; the fourth lane of each corner holds an int.
+//   interior node: leftFirst is the left child, the right child follows it; count is 0
+//   leaf node:     leftFirst is the first of count entries in the object arrays
+//   object box:    leftFirst is the object, count is 1
+struct BvhNode
+{
+    glm::vec3 min;
+    int leftFirst;
+    glm::vec3 max;
+    int count;
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+// How a box lies with respect to a frustum
+enum FrustumOverlap {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+// Frustum planes one array per component, padded to 8 with planes that contain everything,
+// so the planes are tested four at a time
+struct FrustumLanes
+{
+    alignas(16) float x[8];
+    alignas(16) float y[8];
+    alignas(16) float z[8];
+    alignas(16) float w[8];
+};
+
+FrustumLanes frustumLanes(const Frustum &frustum) {
+    FrustumLanes lanes;
+    for (int p = 0; p < 8; p++) {
+        glm::vec4 plane = p < 6 ? frustum.planes[p] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        lanes.x[p] = plane.x;
+        lanes.y[p] = plane.y;
+        lanes.z[p] = plane.z;
+        lanes.w[p] = plane.w;
+    }
+    return lanes;
+}
+
+// Outside when the corner furthest along some plane's normal is behind it, inside when even the
+// nearest corner is in front of every plane
+FrustumOverlap frustumOverlap(const FrustumLanes &lanes, const BvhNode &box) {
+#ifdef USE_SSE
+    const __m128 zero = _mm_setzero_ps();
+    __m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+    __m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+    int straddles = 0;
+    for (int group = 0; group < 8; group += 4) {
+        __m128 x = _mm_load_ps(lanes.x + group);
+        __m128 y = _mm_load_ps(lanes.y + group);
+        __m128 z = _mm_load_ps(lanes.z + group);
+        __m128 w = _mm_load_ps(lanes.w + group);
+        __m128 positiveX = _mm_cmpge_ps(x, zero), positiveY = _mm_cmpge_ps(y, zero), positiveZ = _mm_cmpge_ps(z, zero);
+        __m128 farX = _mm_or_ps(_mm_and_ps(positiveX, maxX), _mm_andnot_ps(positiveX, minX));
+        __m128 farY = _mm_or_ps(_mm_and_ps(positiveY, maxY), _mm_andnot_ps(positiveY, minY));
+        __m128 farZ = _mm_or_ps(_mm_and_ps(positiveZ, maxZ), _mm_andnot_ps(positiveZ, minZ));
+        __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, farX), _mm_mul_ps(y, farY)), _mm_add_ps(_mm_mul_ps(z, farZ), w));
+        if (_mm_movemask_ps(_mm_cmplt_ps(farDistance, zero)) != 0) {
+            return FRUSTUM_OUTSIDE;
+        }
+        __m128 nearX = _mm_or_ps(_mm_and_ps(positiveX, minX), _mm_andnot_ps(positiveX, maxX));
+        __m128 nearY = _mm_or_ps(_mm_and_ps(positiveY, minY), _mm_andnot_ps(positiveY, maxY));
+        __m128 nearZ = _mm_or_ps(_mm_and_ps(positiveZ, minZ), _mm_andnot_ps(positiveZ, maxZ));
+        __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, nearX), _mm_mul_ps(y, nearY)), _mm_add_ps(_mm_mul_ps(z, nearZ), w));
+        straddles |= _mm_movemask_ps(_mm_cmplt_ps(nearDistance, zero));
+    }
+    return straddles != 0 ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#else
+    bool straddles = false;
+    for (int p = 0; p < 6; p++) {
+        glm::vec3 normal(lanes.x[p], lanes.y[p], lanes.z[p]);
+        glm::vec3 farCorner(normal.x >= 0.0f ? box.max.x : box.min.x, normal.y >= 0.0f ? box.max.y : box.min.y, normal.z >= 0.0f ? box.max.z : box.min.z);
+        glm::vec3 nearCorner(normal.x >= 0.0f ? box.min.x : box.max.x, normal.y >= 0.0f ? box.min.y : box.max.y, normal.z >= 0.0f ? box.min.z : box.max.z);
+        if (glm::dot(normal, farCorner) + lanes.w[p] < 0.0f) {
+            return FRUSTUM_OUTSIDE;
+        }
+        straddles = straddles || glm::dot(normal, nearCorner) + lanes.w[p] < 0.0f;
+    }
+    return straddles ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#endif
+}
+
+// A ray with its reciprocal direction, ready for slab tests
+struct BvhRay
+{
+    glm::vec3 origin;
+    glm::vec3 inverseDirection;
+};
+
+// Distance along the ray to where it enters the box, or FLT_MAX if it misses within maxDistance.
+// A ray that starts inside the box enters it at 0.
+float rayBoxDistance(const BvhRay &ray, const BvhNode &box, float maxDistance) {
+#ifdef USE_SSE
+    // The fourth lane holds an int; copy x into it so it never decides the result
+    __m128 low = _mm_loadu_ps(&box.min.x);
+    __m128 high = _mm_loadu_ps(&box.max.x);
+    low = _mm_shuffle_ps(low, low, _MM_SHUFFLE(0, 2, 1, 0));
+    high = _mm_shuffle_ps(high, high, _MM_SHUFFLE(0, 2, 1, 0));
+    __m128 origin = _mm_setr_ps(ray.origin.x, ray.origin.y, ray.origin.z, ray.origin.x);
+    __m128 inverse = _mm_setr_ps(ray.inverseDirection.x, ray.inverseDirection.y, ray.inverseDirection.z, ray.inverseDirection.x);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(low, origin), inverse);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(high, origin), inverse);
+    __m128 entries = _mm_min_ps(t1, t2);
+    __m128 exits = _mm_max_ps(t1, t2);
+    // Largest entry and smallest exit across the three axes
+    entries = _mm_max_ps(entries, _mm_shuffle_ps(entries, entries, _MM_SHUFFLE(2, 1, 0, 3)));
+    entries = _mm_max_ps(entries, _mm_shuffle_ps(entries, entries, _MM_SHUFFLE(1, 0, 3, 2)));
+    exits = _mm_min_ps(exits, _mm_shuffle_ps(exits, exits, _MM_SHUFFLE(2, 1, 0, 3)));
+    exits = _mm_min_ps(exits, _mm_shuffle_ps(exits, exits, _MM_SHUFFLE(1, 0, 3, 2)));
+    float entry = std::max(_mm_cvtss_f32(entries), 0.0f);
+    float exit = std::min(_mm_cvtss_f32(exits), maxDistance);
+#else
+    float entry = 0.0f, exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++) {
+        float t1 = (box.min[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+        float t2 = (box.max[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+        entry = std::max(entry, std::min(t1, t2));
+        exit = std::min(exit, std::max(t1, t2));
+    }
+#endif
+    return entry <= exit ? entry : FLT_MAX;
+}
+
+// True if the box comes within radius of center
+bool sphereOverlapsBox(const glm::vec3 &center, float radius, const BvhNode &box) {
+#ifdef USE_SSE
+    __m128 point = _mm_setr_ps(center.x, center.y, center.z, 0.0f);
+    __m128 closest = _mm_min_ps(_mm_max_ps(point, _mm_loadu_ps(&box.min.x)), _mm_loadu_ps(&box.max.x));
+    // Only the first three lanes are summed; the fourth holds an int
+    __m128 offset = _mm_sub_ps(point, closest);
+    __m128 squared = _mm_mul_ps(offset, offset);
+    __m128 sum = _mm_add_ss(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1)));
+    sum = _mm_add_ss(sum, _mm_movehl_ps(squared, squared));
+    return _mm_cvtss_f32(sum) <= radius * radius;
+#else
+    glm::vec3 offset = center - glm::clamp(center, box.min, box.max);
+    return glm::dot(offset, offset) <= radius * radius;
+#endif
+}
+
+// Nodes waiting to be visited by a depth first query. Visiting a node replaces it with its two
+// children, so a tree depth levels deep never has more than depth + 1 waiting.
+struct BvhStack
+{
+    int fixed[BVH_STACK_SIZE];
+    std::vector<int> overflow;
+    int* nodes;
+    int size;
+
+    BvhStack(int depth) {
+        nodes = fixed;
+        size = 0;
+        if (depth + 1 > BVH_STACK_SIZE) {
+            overflow.resize(depth + 1);
+            nodes = overflow.data();
+        }
+    }
+};
+
+// A bounding volume hierarchy over objects that rarely move. Objects are known by their index
+// in the bounds they were built from. Nodes are kept depth first in one array: a node's children
+// are adjacent and come after it, and the objects under any node are a contiguous range.
+class BoundingVolumeHierarchy
+{
+    public:
+
+        // Build over the world bounds of every object, splitting by the surface area heuristic
+        void build(const BoundsBatch &bounds);
+
+        // Update the boxes after objects have moved, keeping the tree's shape; rebuild after large moves
+        void refit(const BoundsBatch &bounds);
+
+        // Append the objects whose box is at least partly inside the frustum
+        void queryFrustum(const Frustum &frustum, std::vector<int> &results) const;
+
+        // Append the objects whose box comes within radius of center
+        void querySphere(const glm::vec3 &center, float radius, std::vector<int> &results) const;
+
+        // The nearest object whose box the ray hits within maxDistance, or -1; distance is set to where it enters
+        int raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) const;
+
+        int size() const;
+        int nodeCount() const;
+
+        // Levels below the root, which bounds how much a query has to keep waiting
+        int depth() const;
+
+    private:
+        std::vector<BvhNode> nodes;
+
+        // Object boxes in tree order; leaf ranges index into it
+        std::vector<BvhNode> objects;
+
+        int maxDepth = 0;
+
+        // Split the node at index, then its children, until every leaf is small or cheap enough
+        void subdivide(int index, std::vector<glm::vec3> &centroids);
+
+        void updateNode(int index);
+
+        // Append every object under the node without testing it
+        void appendAll(int index, std::vector<int> &results) const;
+};
+
+void BoundingVolumeHierarchy::build(const BoundsBatch &bounds) {
+    int count = bounds.minX.size();
+    objects.resize(count);
+    std::vector<glm::vec3> centroids(count);
+    for (int i = 0; i < count; i++) {
+        objects[i].min = glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]);
+        objects[i].max = glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]);
+        objects[i].leftFirst = i;
+        objects[i].count = 1;
+        centroids[i] = (objects[i].min + objects[i].max) * 0.5f;
+    }
+
+    nodes.clear();
+    maxDepth = 0;
+    nodes.reserve(std::max(1, 2 * count - 1));
+    BvhNode root;
+    root.leftFirst = 0;
+    root.count = count;
+    nodes.push_back(root);
+    updateNode(0);
+    subdivide(0, centroids);
+}
+
+void BoundingVolumeHierarchy::updateNode(int index) {
+    BvhNode &node = nodes[index];
+    // Children never sit at index 0, so an empty root reads as an empty leaf
+    if (node.count == 0 && node.leftFirst > 0) {
+        const BvhNode &left = nodes[node.leftFirst];
+        const BvhNode &right = nodes[node.leftFirst + 1];
+        node.min = glm::min(left.min, right.min);
+        node.max = glm::max(left.max, right.max);
+        return;
+    }
+    node.min = glm::vec3(FLT_MAX);
+    node.max = glm::vec3(-FLT_MAX);
+    for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+        node.min = glm::min(node.min, objects[i].min);
+        node.max = glm::max(node.max, objects[i].max);
+    }
+}
+
+// Half the surface area of a box, which is all the heuristic needs
+float halfArea(const glm::vec3 &low, const glm::vec3 &high) {
+    glm::vec3 size = glm::max(high - low, glm::vec3(0.0f));
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+void BoundingVolumeHierarchy::subdivide(int index, std::vector<glm::vec3> &centroids) {
+    // Children are always added after their parent, so a stack of pending nodes keeps the array depth first
+    std::vector<std::pair<int, int> > pending(1, std::make_pair(index, 0));
+    while (!pending.empty()) {
+        int current = pending.back().first;
+        int level = pending.back().second;
+        pending.pop_back();
+        maxDepth = std::max(maxDepth, level);
+        int first = nodes[current].leftFirst;
+        int count = nodes[current].count;
+        if (count <= 1) {
+            continue;
+        }
+
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+        for (int i = first; i < first + count; i++) {
+            low = glm::min(low, centroids[i]);
+            high = glm::max(high, centroids[i]);
+        }
+
+        // Sort the centroids into bins along each axis and sweep for the cheapest boundary
+        float bestCost = FLT_MAX;
+        int bestAxis = -1, bestBin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = high[axis] - low[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+            float scale = BVH_BINS / extent;
+            int binCount[BVH_BINS] = {0};
+            glm::vec3 binLow[BVH_BINS], binHigh[BVH_BINS];
+            for (int b = 0; b < BVH_BINS; b++) {
+                binLow[b] = glm::vec3(FLT_MAX);
+                binHigh[b] = glm::vec3(-FLT_MAX);
+            }
+            for (int i = first; i < first + count; i++) {
+                int b = std::min(BVH_BINS - 1, (int)((centroids[i][axis] - low[axis]) * scale));
+                binCount[b]++;
+                binLow[b] = glm::min(binLow[b], objects[i].min);
+                binHigh[b] = glm::max(binHigh[b], objects[i].max);
+            }
+            float leftArea[BVH_BINS - 1];
+            int leftCount[BVH_BINS - 1];
+            glm::vec3 sweepLow(FLT_MAX), sweepHigh(-FLT_MAX);
+            int sweepCount = 0;
+            for (int b = 0; b < BVH_BINS - 1; b++) {
+                sweepCount += binCount[b];
+                sweepLow = glm::min(sweepLow, binLow[b]);
+                sweepHigh = glm::max(sweepHigh, binHigh[b]);
+                leftCount[b] = sweepCount;
+                leftArea[b] = halfArea(sweepLow, sweepHigh);
+            }
+            sweepLow = glm::vec3(FLT_MAX);
+            sweepHigh = glm::vec3(-FLT_MAX);
+            sweepCount = 0;
+            for (int b = BVH_BINS - 1; b > 0; b--) {
+                sweepCount += binCount[b];
+                sweepLow = glm::min(sweepLow, binLow[b]);
+                sweepHigh = glm::max(sweepHigh, binHigh[b]);
+                if (leftCount[b - 1] == 0 || sweepCount == 0) {
+                    continue;
+                }
+                float cost = leftCount[b - 1] * leftArea[b - 1] + sweepCount * halfArea(sweepLow, sweepHigh);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // Keep a leaf when no split beats testing its objects directly
+        float area = halfArea(nodes[current].min, nodes[current].max);
+        float leafCost = count * area;
+        float splitCost = BVH_TRAVERSAL_COST * area + bestCost;
+        int middle = first;
+        if (bestAxis >= 0 && (splitCost < leafCost || count > BVH_MAX_LEAF_SIZE)) {
+            float scale = BVH_BINS / (high[bestAxis] - low[bestAxis]);
+            int last = first + count - 1;
+            middle = first;
+            while (middle <= last) {
+                int b = std::min(BVH_BINS - 1, (int)((centroids[middle][bestAxis] - low[bestAxis]) * scale));
+                if (b < bestBin) {
+                    middle++;
+                } else {
+                    std::swap(objects[middle], objects[last]);
+                    std::swap(centroids[middle], centroids[last]);
+                    last--;
+                }
+            }
+        } else if (count > BVH_MAX_LEAF_SIZE) {
+            // Every centroid in the same place: no plane separates them, so split the range in half
+            middle = first + count / 2;
+        }
+        if (middle == first || middle == first + count) {
+            continue;
+        }
+
+        int left = nodes.size();
+        BvhNode child;
+        child.leftFirst = first;
+        child.count = middle - first;
+        nodes.push_back(child);
+        child.leftFirst = middle;
+        child.count = first + count - middle;
+        nodes.push_back(child);
+        nodes[current].leftFirst = left;
+        nodes[current].count = 0;
+        updateNode(left);
+        updateNode(left + 1);
+        pending.push_back(std::make_pair(left + 1, level + 1));
+        pending.push_back(std::make_pair(left, level + 1));
+    }
+}
+
+void BoundingVolumeHierarchy::refit(const BoundsBatch &bounds) {
+    for (BvhNode &object : objects) {
+        int i = object.leftFirst;
+        object.min = glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]);
+        object.max = glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]);
+    }
+    // Children come after their parents, so walking backwards finishes them first
+    for (int index = nodes.size() - 1; index >= 0; index--) {
+        updateNode(index);
+    }
+}
+
+void BoundingVolumeHierarchy::appendAll(int index, std::vector<int> &results) const {
+    // The objects under a node are contiguous, so the range runs from its leftmost to its rightmost leaf
+    int first = index, last = index;
+    while (nodes[first].count == 0) {
+        first = nodes[first].leftFirst;
+    }
+    while (nodes[last].count == 0) {
+        last = nodes[last].leftFirst + 1;
+    }
+    for (int i = nodes[first].leftFirst; i < nodes[last].leftFirst + nodes[last].count; i++) {
+        results.push_back(objects[i].leftFirst);
+    }
+}
+
+void BoundingVolumeHierarchy::queryFrustum(const Frustum &frustum, std::vector<int> &results) const {
+    if (objects.empty()) {
+        return;
+    }
+    FrustumLanes lanes = frustumLanes(frustum);
+    BvhStack stack(maxDepth);
+    stack.nodes[stack.size++] = 0;
+    while (stack.size > 0) {
+        const BvhNode &node = nodes[stack.nodes[--stack.size]];
+        FrustumOverlap overlap = frustumOverlap(lanes, node);
+        if (overlap == FRUSTUM_OUTSIDE) {
+            continue;
+        }
+        if (overlap == FRUSTUM_INSIDE) {
+            appendAll(&node - nodes.data(), results);
+            continue;
+        }
+        if (node.count > 0) {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                if (frustumOverlap(lanes, objects[i]) != FRUSTUM_OUTSIDE) {
+                    results.push_back(objects[i].leftFirst);
+                }
+            }
+            continue;
+        }
+        stack.nodes[stack.size++] = node.leftFirst + 1;
+        stack.nodes[stack.size++] = node.leftFirst;
+    }
+}
+
+void BoundingVolumeHierarchy::querySphere(const glm::vec3 &center, float radius, std::vector<int> &results) const {
+    if (objects.empty()) {
+        return;
+    }
+    BvhStack stack(maxDepth);
+    stack.nodes[stack.size++] = 0;
+    while (stack.size > 0) {
+        const BvhNode &node = nodes[stack.nodes[--stack.size]];
+        if (!sphereOverlapsBox(center, radius, node)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                if (sphereOverlapsBox(center, radius, objects[i])) {
+                    results.push_back(objects[i].leftFirst);
+                }
+            }
+            continue;
+        }
+        stack.nodes[stack.size++] = node.leftFirst + 1;
+        stack.nodes[stack.size++] = node.leftFirst;
+    }
+}
+
+int BoundingVolumeHierarchy::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) const {
+    int hit = -1;
+    distance = maxDistance;
+    if (objects.empty()) {
+        return hit;
+    }
+    BvhRay ray;
+    ray.origin = origin;
+    ray.inverseDirection = 1.0f / direction;
+
+    // Visit the nearer child first, so far subtrees are skipped once something closer is hit
+    BvhStack stack(maxDepth);
+    if (rayBoxDistance(ray, nodes[0], distance) == FLT_MAX) {
+        return hit;
+    }
+    stack.nodes[stack.size++] = 0;
+    while (stack.size > 0) {
+        const BvhNode &node = nodes[stack.nodes[--stack.size]];
+        if (node.count > 0) {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                float entry = rayBoxDistance(ray, objects[i], distance);
+                if (entry != FLT_MAX && (hit < 0 || entry < distance)) {
+                    distance = entry;
+                    hit = objects[i].leftFirst;
+                }
+            }
+            continue;
+        }
+        int nearChild = node.leftFirst, farChild = node.leftFirst + 1;
+        float nearEntry = rayBoxDistance(ray, nodes[nearChild], distance);
+        float farEntry = rayBoxDistance(ray, nodes[farChild], distance);
+        if (farEntry < nearEntry) {
+            std::swap(nearChild, farChild);
+            std::swap(nearEntry, farEntry);
+        }
+        if (farEntry != FLT_MAX) {
+            stack.nodes[stack.size++] = farChild;
+        }
+        if (nearEntry != FLT_MAX) {
+            stack.nodes[stack.size++] = nearChild;
+        }
+    }
+    return hit;
+}
+
+int BoundingVolumeHierarchy::size() const {
+    return objects.size();
+}
+
+int BoundingVolumeHierarchy::nodeCount() const {
+    return nodes.size();
+}
+
+int BoundingVolumeHierarchy::depth() const {
+    return maxDepth;
+}
+#endif
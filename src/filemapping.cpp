@@ -0,0 +1,81 @@
+#include "filemapping.h"
+
+#ifdef _WIN32
+// Only the file and mapping calls are needed; keep min/max and the rest of the Windows macros out
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool mapFile(const std::string &path, FileMapping &view) {
+    unmapFile(view);
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    view.file = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        unmapFile(view);
+        return false;
+    }
+    view.mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (view.mapping == NULL) {
+        unmapFile(view);
+        return false;
+    }
+    view.data = (const unsigned char*)MapViewOfFile((HANDLE)view.mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view.data == nullptr) {
+        unmapFile(view);
+        return false;
+    }
+    view.size = (size_t)fileSize.QuadPart;
+#else
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close(descriptor);
+        return false;
+    }
+    void* mapped = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping keeps the file alive on its own
+    close(descriptor);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    view.data = (const unsigned char*)mapped;
+    view.size = status.st_size;
+#endif
+    return true;
+}
+
+void unmapFile(FileMapping &view) {
+#ifdef _WIN32
+    if (view.data != nullptr) {
+        UnmapViewOfFile(view.data);
+    }
+    if (view.mapping != nullptr) {
+        CloseHandle((HANDLE)view.mapping);
+    }
+    if (view.file != nullptr) {
+        CloseHandle((HANDLE)view.file);
+    }
+#else
+    if (view.data != nullptr) {
+        munmap((void*)view.data, view.size);
+    }
+#endif
+    view.data = nullptr;
+    view.size = 0;
+    view.file = nullptr;
+    view.mapping = nullptr;
+}
@@ -0,0 +1,24 @@
+#ifndef FILEMAPPING_H
+#define FILEMAPPING_H
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory. The platform code lives in filemapping.cpp, so
+// <windows.h> and its macros stay out of the headers that use this.
+struct FileMapping
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    // Windows handles for the open file and its mapping; unused on other platforms
+    void* file = nullptr;
+    void* mapping = nullptr;
+};
+
+// Map the file at path. Returns false and leaves view empty if the file is missing, empty or cannot be mapped.
+bool mapFile(const std::string &path, FileMapping &view);
+
+// Unmap a file mapped by mapFile(); pointers into it are invalid afterwards
+void unmapFile(FileMapping &view);
+#endif
@@ -0,0 +1,142 @@
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+// Binding points of the uniform blocks every shader shares; the same in every program
+const int UNIFORM_BINDING_CAMERA = 0;
+const int UNIFORM_BINDING_LIGHTS = 1;
+
+// Must match NR_POINT_LIGHTS in multiLight.fs
+const int NR_POINT_LIGHTS = 1;
+
+// The structs below mirror the std140 layout of the GLSL blocks: a vec3 takes 16 bytes
+// unless a float follows to fill it, and every struct starts on a 16 byte boundary.
+
+// uniform Camera in every vertex shader, and in multiLight.fs
+struct CameraData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPos;
+    float padding;
+};
+static_assert(sizeof(CameraData) == 144, "CameraData must match the std140 Camera block");
+
+struct DirLightData
+{
+    glm::vec3 direction;
+    float padding0;
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+static_assert(sizeof(DirLightData) == 64, "DirLightData must match the std140 DirLight struct");
+
+struct PointLightData
+{
+    glm::vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    float padding0[2];
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+static_assert(sizeof(PointLightData) == 80 && offsetof(PointLightData, ambient) == 32, "PointLightData must match the std140 PointLight struct");
+
+// uniform Lights in multiLight.fs
+struct LightsData
+{
+    DirLightData dirLight;
+    PointLightData pointLights[NR_POINT_LIGHTS];
+};
+
+// Camera and light data for the frame, kept in one uniform buffer that every program reads
+// through the fixed binding points. Fill camera and lights, then update() writes it all at once.
+class FrameUniforms
+{
+    public:
+
+        FrameUniforms();
+
+        // Create the buffer and attach its two ranges to the binding points
+        void init();
+
+        // Point a program's Camera and Lights blocks at the binding points; programs without a block skip it
+        void attach(Shader &shader);
+
+        // Upload camera and lights with a single buffer write
+        void update();
+
+        CameraData camera;
+        LightsData lights;
+
+    private:
+        unsigned int UBOc;
+        int lightsOffset; // the Lights range starts on the driver's offset alignment
+        std::vector<unsigned char> staging;
+};
+
+FrameUniforms::FrameUniforms() {
+    memset(&camera, 0, sizeof(camera));
+    memset(&lights, 0, sizeof(lights));
+    UBOc = 0;
+    lightsOffset = 0;
+}
+
+void FrameUniforms::init() {
+    int alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = alignment > 0 ? alignment : 256;
+    lightsOffset = (sizeof(CameraData) + alignment - 1) / alignment * alignment;
+    staging.resize(lightsOffset + sizeof(LightsData));
+
+    glGenBuffers(1, &UBOc);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBOc);
+    glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING_CAMERA, UBOc, 0, sizeof(CameraData));
+    glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING_LIGHTS, UBOc, lightsOffset, sizeof(LightsData));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniforms::attach(Shader &shader) {
+    unsigned int cameraBlock = glGetUniformBlockIndex(shader.ID, "Camera");
+    if (cameraBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.ID, cameraBlock, UNIFORM_BINDING_CAMERA);
+    }
+    unsigned int lightsBlock = glGetUniformBlockIndex(shader.ID, "Lights");
+    if (lightsBlock != GL_INVALID_INDEX) {
+        int size = 0;
+        glGetActiveUniformBlockiv(shader.ID, lightsBlock, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (size != (int)sizeof(LightsData)) {
+            std::cout << "ERROR::UNIFORM_BLOCK::SIZE_MISMATCH Lights is " << size << " bytes in the shader" << std::endl;
+        }
+        glUniformBlockBinding(shader.ID, lightsBlock, UNIFORM_BINDING_LIGHTS);
+    }
+}
+
+void FrameUniforms::update() {
+    memcpy(staging.data(), &camera, sizeof(CameraData));
+    memcpy(staging.data() + lightsOffset, &lights, sizeof(LightsData));
+    glBindBuffer(GL_UNIFORM_BUFFER, UBOc);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+#endif
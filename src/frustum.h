@@ -0,0 +1,86 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "simd.h"
+
+// Planes of the view volume, normals pointing inwards: left, right, bottom, top, near, far
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// How many objects survived culling this frame, out of how many were tested
+struct CullStats
+{
+    int visible;
+    int total;
+};
+
+// Take the planes straight from the rows of projection * view, so perspective and
+// orthographic projections work alike. Each plane is normalized to make distances real.
+Frustum extractFrustum(const glm::mat4 &viewProjection) {
+    // glm stores columns, so row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+    }
+    Frustum frustum;
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[2 * axis] = rows[3] + rows[axis];
+        frustum.planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+    for (glm::vec4 &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+// Test each box in the batch against the frustum and set visible[i] to 1 or 0; returns the number visible.
+// A box is culled once its corner furthest along some plane's normal is still behind that plane.
+// Boxes that straddle a corner of the frustum are kept, which only costs a draw.
+int cullBounds(const Frustum &frustum, const BoundsBatch &batch, std::vector<unsigned char> &visible) {
+    int count = batch.minX.size();
+    visible.resize(count);
+    int visibleCount = 0;
+    int i = 0;
+#ifdef USE_SSE
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 outside = zero;
+        for (const glm::vec4 &plane : frustum.planes) {
+            // The corner furthest along the normal takes max on positive axes and min on negative ones
+            __m128 x = _mm_loadu_ps((plane.x >= 0.0f ? batch.maxX.data() : batch.minX.data()) + i);
+            __m128 y = _mm_loadu_ps((plane.y >= 0.0f ? batch.maxY.data() : batch.minY.data()) + i);
+            __m128 z = _mm_loadu_ps((plane.z >= 0.0f ? batch.maxZ.data() : batch.minZ.data()) + i);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+        }
+        int culled = _mm_movemask_ps(outside);
+        for (int lane = 0; lane < 4; lane++) {
+            visible[i + lane] = (culled >> lane) & 1 ? 0 : 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        bool inside = true;
+        for (const glm::vec4 &plane : frustum.planes) {
+            float x = plane.x >= 0.0f ? batch.maxX[i] : batch.minX[i];
+            float y = plane.y >= 0.0f ? batch.maxY[i] : batch.minY[i];
+            float z = plane.z >= 0.0f ? batch.maxZ[i] : batch.minZ[i];
+            if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f) {
+                inside = false;
+            }
+        }
+        visible[i] = inside ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+#endif
@@ -0,0 +1,194 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstdint>
+#include <map>
+
+// Texture units whose bindings are tracked; binds on higher units always reach GL
+const int GL_STATE_TEXTURE_UNITS = 16;
+
+// Marks a binding the cache does not know, so the next call for it is always issued
+const GLuint GL_STATE_UNKNOWN = 0xFFFFFFFF;
+
+// Calls that reached GL and calls skipped because they would not have changed anything
+struct GLStateCounters
+{
+    int issued;
+    int filtered;
+};
+
+// A mirror of the GL state the renderer changes most: program, vertex array, textures and
+// samplers per unit, enable bits, depth writes, blending and the restart index. A call that
+// matches the mirror is dropped. Everything starts unknown, and any code that changes this
+// state directly must call invalidate() afterwards.
+class GLState
+{
+    public:
+
+        // The mirror for the one GL context the program uses
+        static GLState& shared();
+
+        GLState();
+
+        void useProgram(GLuint program);
+        void bindVertexArray(GLuint vertexArray);
+        void bindTexture(int unit, GLenum target, GLuint texture);
+        void bindSampler(int unit, GLuint sampler);
+        void enable(GLenum capability);
+        void disable(GLenum capability);
+        void depthMask(bool write);
+        void blendFunc(GLenum source, GLenum destination);
+        void primitiveRestartIndex(GLuint index);
+
+        // Forget everything, so every following call is issued
+        void invalidate();
+
+        // Start counting a new frame; the finished frame's counts move to lastFrame
+        void beginFrame();
+
+        GLStateCounters frame;
+        GLStateCounters lastFrame;
+
+    private:
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        GLenum textureTargets[GL_STATE_TEXTURE_UNITS];
+        GLuint textures[GL_STATE_TEXTURE_UNITS];
+        GLuint samplers[GL_STATE_TEXTURE_UNITS];
+        std::map<GLenum, bool> capabilities; // capabilities not in the map are unknown
+        GLuint depthWrite;
+        GLenum blendSource, blendDestination;
+        int64_t restartIndex;   // -1 when unknown, since every 32-bit value is a valid index
+
+        // Count the call and return true if it has to be issued
+        bool changes(bool same);
+
+        void setCapability(GLenum capability, bool enabled);
+};
+
+GLState& GLState::shared() {
+    static GLState state;
+    return state;
+}
+
+GLState::GLState() {
+    frame = {0, 0};
+    lastFrame = {0, 0};
+    invalidate();
+}
+
+void GLState::invalidate() {
+    program = GL_STATE_UNKNOWN;
+    vertexArray = GL_STATE_UNKNOWN;
+    activeUnit = GL_STATE_UNKNOWN;
+    for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+        textureTargets[unit] = GL_STATE_UNKNOWN;
+        textures[unit] = GL_STATE_UNKNOWN;
+        samplers[unit] = GL_STATE_UNKNOWN;
+    }
+    capabilities.clear();
+    depthWrite = GL_STATE_UNKNOWN;
+    blendSource = blendDestination = GL_STATE_UNKNOWN;
+    restartIndex = -1;
+}
+
+void GLState::beginFrame() {
+    lastFrame = frame;
+    frame = {0, 0};
+}
+
+bool GLState::changes(bool same) {
+    if (same) {
+        frame.filtered++;
+        return false;
+    }
+    frame.issued++;
+    return true;
+}
+
+void GLState::useProgram(GLuint id) {
+    if (changes(program == id)) {
+        glUseProgram(id);
+        program = id;
+    }
+}
+
+void GLState::bindVertexArray(GLuint id) {
+    if (changes(vertexArray == id)) {
+        glBindVertexArray(id);
+        vertexArray = id;
+    }
+}
+
+void GLState::bindTexture(int unit, GLenum target, GLuint texture) {
+    bool tracked = unit >= 0 && unit < GL_STATE_TEXTURE_UNITS;
+    if (!changes(tracked && textureTargets[unit] == target && textures[unit] == texture)) {
+        return;
+    }
+    // The active unit is only changed on the way to a bind that is actually needed
+    if (activeUnit != (GLuint)unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    if (tracked) {
+        textureTargets[unit] = target;
+        textures[unit] = texture;
+    }
+}
+
+void GLState::bindSampler(int unit, GLuint sampler) {
+    bool tracked = unit >= 0 && unit < GL_STATE_TEXTURE_UNITS;
+    if (changes(tracked && samplers[unit] == sampler)) {
+        glBindSampler(unit, sampler);
+        if (tracked) {
+            samplers[unit] = sampler;
+        }
+    }
+}
+
+void GLState::setCapability(GLenum capability, bool enabled) {
+    std::map<GLenum, bool>::iterator found = capabilities.find(capability);
+    if (changes(found != capabilities.end() && found->second == enabled)) {
+        if (enabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+        capabilities[capability] = enabled;
+    }
+}
+
+void GLState::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLState::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLState::depthMask(bool write) {
+    if (changes(depthWrite == (GLuint)write)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        depthWrite = write;
+    }
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination) {
+    if (changes(blendSource == source && blendDestination == destination)) {
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+    }
+}
+
+void GLState::primitiveRestartIndex(GLuint index) {
+    if (changes(restartIndex == (int64_t)index)) {
+        glPrimitiveRestartIndex(index);
+        restartIndex = index;
+    }
+}
+#endif
@@ -0,0 +1,242 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "shader.h"
+#include "mesh.h"
+#include "shapes.h"
+#include "frustum.h"
+#include "instancing.h"
+#include "ringbuffer.h"
+
+// Threads per work group in cullObjects.cs
+const int INDIRECT_CULL_GROUP_SIZE = 64;
+
+// One object as cullObjects.cs reads it, in std430 layout
+struct IndirectObject
+{
+    glm::mat4 model;
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    int32_t materialIndex;
+};
+static_assert(sizeof(IndirectObject) == 112, "IndirectObject must match Object in cullObjects.cs");
+
+// The record glMultiDrawElementsIndirect reads for each draw
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// A run of commands that share a primitive and index type, drawn with one indirect call
+struct IndirectGroup
+{
+    GLenum primitive;
+    GLenum indexType;
+    int first;
+    int count;
+};
+
+// Draws pooled shapes without per-object CPU work: the objects go to the GPU in one buffer,
+// a compute pass tests them against the frustum and writes one draw command and instance each,
+// and the whole set is drawn with one glMultiDrawElementsIndirect per primitive and index type.
+// Needs GL 4.3 for compute, storage buffers and multi draw indirect; check supported() first.
+class IndirectRenderer
+{
+    public:
+
+        IndirectRenderer();
+        ~IndirectRenderer();
+
+        // True when the context can run this path; otherwise draw with InstancedRenderer or the RenderQueue
+        static bool supported();
+
+        // Add a shape whose meshes come from the MeshCache pool; call build() once all shapes are added
+        void add(Shape &shape);
+
+        // Load the cull program and create the command, instance and object buffers
+        void build();
+
+        // Upload this frame's objects at their current level of detail and cull them on the GPU
+        void update(const glm::mat4 &parent, const glm::mat4 &viewProjection);
+
+        // Draw the shapes that survived culling
+        void draw(Shader &shader);
+
+        // Indirect calls issued per frame
+        int groupCount();
+
+        // Delete the cull program, VAO and buffers made by build(); call while the context is still current
+        void release();
+
+    private:
+        std::vector<Shape*> shapes;
+        std::vector<IndirectGroup> groups;
+        Shader* cullShader;
+        unsigned int VAOc, commandBuffer, instanceBuffer;
+        int storageAlignment;
+
+        // Objects change every frame, so they go through a ring like the instanced path's
+        RingBuffer objectRing;
+};
+
+IndirectRenderer::IndirectRenderer() {
+    cullShader = nullptr;
+    VAOc = commandBuffer = instanceBuffer = 0;
+    storageAlignment = 256;
+}
+
+IndirectRenderer::~IndirectRenderer() {
+    // The GL objects go with the context unless release() was called first; only the Shader is freed here
+    delete cullShader;
+}
+
+void IndirectRenderer::release() {
+    // Nothing may stay cached as bound, or a new object given a recycled name would never be bound
+    GLState::shared().useProgram(0);
+    GLState::shared().bindVertexArray(0);
+    if (cullShader != nullptr) {
+        glDeleteProgram(cullShader->ID);
+        delete cullShader;
+        cullShader = nullptr;
+    }
+    if (VAOc != 0) {
+        glDeleteVertexArrays(1, &VAOc);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+        VAOc = commandBuffer = instanceBuffer = 0;
+    }
+    objectRing.release();
+}
+
+bool IndirectRenderer::supported() {
+    return GLAD_GL_VERSION_4_3 && glMultiDrawElementsIndirect != NULL;
+}
+
+void IndirectRenderer::add(Shape &shape) {
+    shapes.push_back(&shape);
+}
+
+void IndirectRenderer::build() {
+    release();
+    cullShader = new Shader("../shaders/cullObjects.cs");
+
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    storageAlignment = storageAlignment > 0 ? storageAlignment : 256;
+    // Each frame's region must start on the alignment glBindBufferRange takes for storage buffers
+    objectRing.init(shapes.size() * sizeof(IndirectObject), storageAlignment);
+
+    // The compute pass fills both; the CPU never touches their contents
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, shapes.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, shapes.size() * sizeof(InstanceData), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // The pool's vertex and index buffers with the instance attributes on top; baseInstance
+    // in each command picks the object's instance record
+    GeometryPool &pool = MeshCache::shared().pool;
+    glGenVertexArrays(1, &VAOc);
+    GLState::shared().bindVertexArray(VAOc);
+    Mesh layout(pool.layout());
+    layout.format = pool.format;
+    layout.VBOc = pool.VBOc;
+    layout.EBOc = pool.EBOc;
+    layout.bindAttributes();
+    pointInstanceAttributes(instanceBuffer, 0);
+    for (int location = 4; location <= 8; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    GLState::shared().bindVertexArray(0);
+
+    for (Shape* shape : shapes) {
+        if (shape->mesh->VAOc != pool.VAOc) {
+            std::cout << "ERROR::INDIRECT::MESH_NOT_POOLED" << std::endl;
+        }
+    }
+}
+
+void IndirectRenderer::update(const glm::mat4 &parent, const glm::mat4 &viewProjection) {
+    objectRing.beginFrame();
+    RingAllocation allocation = objectRing.allocate(shapes.size() * sizeof(IndirectObject), storageAlignment);
+    groups.clear();
+    if (allocation.data == NULL) {
+        return;
+    }
+
+    // Commands for one primitive and index type must be adjacent, so write the objects group by group;
+    // a shape's group can change along with its level of detail
+    std::map<std::pair<GLenum, GLenum>, std::vector<Shape*> > byType;
+    for (Shape* shape : shapes) {
+        byType[std::make_pair(shape->mesh->primitive, shape->mesh->indexType)].push_back(shape);
+    }
+    IndirectObject* objects = (IndirectObject*)allocation.data;
+    int next = 0;
+    for (std::map<std::pair<GLenum, GLenum>, std::vector<Shape*> >::iterator type = byType.begin(); type != byType.end(); ++type) {
+        IndirectGroup group = {type->first.first, type->first.second, next, (int)type->second.size()};
+        for (Shape* shape : type->second) {
+            Mesh* mesh = shape->mesh;
+            const Bounds &local = shape->baseMesh()->bounds;
+            objects[next].model = parent * shape->model;
+            objects[next].boundsMin = glm::vec4(local.min, 0.0f);
+            objects[next].boundsMax = glm::vec4(local.max, 0.0f);
+            objects[next].indexCount = mesh->indexSize;
+            objects[next].firstIndex = mesh->indexOffset / indexTypeSize(mesh->indexType);
+            objects[next].baseVertex = mesh->baseVertex;
+            objects[next].materialIndex = shape->getMaterialIndex();
+            next++;
+        }
+        groups.push_back(group);
+    }
+    objectRing.commit();
+
+    Frustum frustum = extractFrustum(viewProjection);
+    GLState::shared().useProgram(cullShader->ID);
+    glUniform4fv(cullShader->location("planes"), 6, glm::value_ptr(frustum.planes[0]));
+    cullShader->setInt("objectCount", next);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, objectRing.buffer, allocation.offset, next * sizeof(IndirectObject));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, instanceBuffer);
+    glDispatchCompute((next + INDIRECT_CULL_GROUP_SIZE - 1) / INDIRECT_CULL_GROUP_SIZE, 1, 1);
+
+    // The draws read the commands as indirect arguments and the instances as vertex attributes
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void IndirectRenderer::draw(Shader &shader) {
+    shader.use();
+    shader.setBool(UNIFORM_INSTANCED, true);
+    GLState::shared().bindVertexArray(VAOc);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    for (const IndirectGroup &group : groups) {
+        setPrimitiveRestart(group.primitive, group.indexType);
+        glMultiDrawElementsIndirect(group.primitive, group.indexType, (void*)(intptr_t)(group.first * sizeof(DrawElementsIndirectCommand)), group.count, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    shader.setBool(UNIFORM_INSTANCED, false);
+    objectRing.endFrame();
+}
+
+int IndirectRenderer::groupCount() {
+    return groups.size();
+}
+#endif
@@ -0,0 +1,207 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "material.h"
+#include "mesh.h"
+#include "shapes.h"
+#include "ringbuffer.h"
+
+// Per-instance vertex data, read by multiLight.vs at locations 4 to 8
+struct InstanceData
+{
+    glm::mat4 model;
+    int materialIndex;
+};
+
+// A run of instances in a batch that are drawn at the same level of detail
+struct InstanceRun
+{
+    Mesh* mesh;
+    int first;
+    int count;
+};
+
+// Every shape that shares one mesh, drawn with one instanced call per level of detail in use
+struct InstanceBatch
+{
+    Mesh* mesh;
+    std::vector<Shape*> shapes;
+    std::vector<InstanceRun> runs;
+    unsigned int VAOc;
+    size_t offset;      // where this frame's instances start in the ring
+    size_t boundOffset; // where the VAO's instance attributes currently point
+};
+
+// Point instance attributes 4 to 8 of the bound VAO at InstanceData records starting at base in buffer
+void pointInstanceAttributes(unsigned int buffer, size_t base) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    // A mat4 attribute takes four consecutive locations, one column each
+    for (int column = 0; column < 4; column++) {
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + column * sizeof(glm::vec4)));
+    }
+    glVertexAttribIPointer(8, 1, GL_INT, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, materialIndex)));
+}
+
+class InstancedRenderer
+{
+    public:
+
+        // Add a shape to be drawn instanced; call build() once all shapes are added
+        void add(Shape &shape);
+
+        // Group the shapes by mesh, create the instance ring and upload the material library
+        void build(Shader &shader, const glm::mat4 &parent);
+
+        // Write this frame's instances, after shapes have moved, changed level of detail or been culled
+        void update(const glm::mat4 &parent);
+
+        // Draw every batch with one call per level of detail in use
+        void draw(Shader &shader);
+
+        // Number of instanced draw calls issued per frame
+        int batchCount();
+
+        // Delete the batches' VAOs and the ring; call while the context is still current
+        void release();
+
+        // Holds every batch's instances, written anew each frame
+        RingBuffer ring;
+
+    private:
+        std::vector<Shape*> shapes;
+        std::vector<InstanceBatch> batches;
+
+        // Point the instance attributes of the bound VAO at the given byte offset in the ring
+        void bindInstanceAttributes(InstanceBatch &batch, size_t offset);
+};
+
+void InstancedRenderer::add(Shape &shape) {
+    shapes.push_back(&shape);
+}
+
+void InstancedRenderer::build(Shader &shader, const glm::mat4 &parent) {
+    // Group the shapes by the mesh they share; shapes with a LOD chain are grouped by its finest level
+    std::map<Mesh*, int> batchOfMesh;
+    for (Shape* shape : shapes) {
+        std::map<Mesh*, int>::iterator found = batchOfMesh.find(shape->baseMesh());
+        if (found == batchOfMesh.end()) {
+            InstanceBatch batch;
+            batch.mesh = shape->baseMesh();
+            batch.VAOc = 0;
+            batch.offset = batch.boundOffset = 0;
+            batchOfMesh[shape->baseMesh()] = batches.size();
+            batches.push_back(batch);
+            batches.back().shapes.push_back(shape);
+        } else {
+            batches[found->second].shapes.push_back(shape);
+        }
+    }
+
+    // Room for every shape once per frame, plus the padding that aligns each batch's start
+    size_t frameBytes = 0;
+    for (InstanceBatch &batch : batches) {
+        frameBytes += batch.shapes.size() * sizeof(InstanceData) + 16;
+    }
+    ring.init(frameBytes);
+
+    for (InstanceBatch &batch : batches) {
+        // Each batch gets its own VAO so the mesh's own VAO stays free of instance attributes
+        glGenVertexArrays(1, &batch.VAOc);
+        GLState::shared().bindVertexArray(batch.VAOc);
+        batch.mesh->bindAttributes();
+
+        bindInstanceAttributes(batch, 0);
+        for (int location = 4; location <= 8; location++) {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+    GLState::shared().bindVertexArray(0);
+    update(parent);
+
+    MaterialLibrary::shared().upload(shader);
+}
+
+void InstancedRenderer::release() {
+    GLState::shared().bindVertexArray(0);
+    for (InstanceBatch &batch : batches) {
+        if (batch.VAOc != 0) {
+            glDeleteVertexArrays(1, &batch.VAOc);
+            batch.VAOc = 0;
+        }
+    }
+    ring.release();
+}
+
+void InstancedRenderer::bindInstanceAttributes(InstanceBatch &batch, size_t base) {
+    pointInstanceAttributes(ring.buffer, base);
+    batch.boundOffset = base;
+}
+
+void InstancedRenderer::update(const glm::mat4 &parent) {
+    ring.beginFrame();
+    for (InstanceBatch &batch : batches) {
+        // Write the visible instances grouped by the mesh each shape is drawn with this frame,
+        // straight into the ring; the writes only go forward, as the memory may be uncached
+        batch.runs.clear();
+        RingAllocation allocation = ring.allocate(batch.shapes.size() * sizeof(InstanceData));
+        if (allocation.data == NULL) {
+            continue;
+        }
+        InstanceData* instances = (InstanceData*)allocation.data;
+        batch.offset = allocation.offset;
+        std::vector<bool> written(batch.shapes.size(), false);
+        int next = 0;
+        for (unsigned int i = 0; i < batch.shapes.size(); i++) {
+            if (written[i] || !batch.shapes[i]->visible) {
+                continue;
+            }
+            InstanceRun run = {batch.shapes[i]->mesh, next, 0};
+            for (unsigned int j = i; j < batch.shapes.size(); j++) {
+                if (!written[j] && batch.shapes[j]->visible && batch.shapes[j]->mesh == run.mesh) {
+                    instances[next].model = parent * batch.shapes[j]->model;
+                    instances[next].materialIndex = batch.shapes[j]->getMaterialIndex();
+                    written[j] = true;
+                    next++;
+                }
+            }
+            run.count = next - run.first;
+            batch.runs.push_back(run);
+        }
+    }
+    ring.commit();
+}
+
+void InstancedRenderer::draw(Shader &shader) {
+    shader.setBool(UNIFORM_INSTANCED, true);
+    for (InstanceBatch &batch : batches) {
+        GLState::shared().bindVertexArray(batch.VAOc);
+        for (const InstanceRun &run : batch.runs) {
+            // Without base instance support the attributes are re-pointed for each run;
+            // the ring moves every frame, so this happens at least once per batch
+            size_t offset = batch.offset + run.first * sizeof(InstanceData);
+            if (batch.boundOffset != offset) {
+                bindInstanceAttributes(batch, offset);
+            }
+            setPrimitiveRestart(run.mesh->primitive, run.mesh->indexType);
+            glDrawElementsInstancedBaseVertex(run.mesh->primitive, run.mesh->indexSize, run.mesh->indexType, (void*)(intptr_t)run.mesh->indexOffset, run.count, run.mesh->baseVertex);
+        }
+    }
+    shader.setBool(UNIFORM_INSTANCED, false);
+    ring.endFrame();
+}
+
+int InstancedRenderer::batchCount() {
+    return batches.size();
+}
+#endif
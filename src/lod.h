@@ -0,0 +1,116 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Largest error, in pixels, a level may show on screen before a finer level is used
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// A coarser level is only taken once its error is below this fraction of LOD_PIXEL_ERROR,
+// so an object sitting right at a threshold does not switch levels every frame
+const float LOD_HYSTERESIS = 0.7f;
+
+// At most this many levels per chain, each with half the tessellation of the one before
+const int LOD_MAX_LEVELS = 4;
+
+// Signature of the functions that give how far a unit mesh of this tessellation strays from the true surface
+typedef float (*LodErrorFunction)(int numSlices, int numSectors);
+
+// Every tessellation of one primitive, finest first
+struct LodChain
+{
+    std::vector<Mesh*> levels;
+    std::vector<float> errors;  // geometric error of each level, in unit mesh space
+};
+
+// Counters for one frame, to tune LOD_PIXEL_ERROR against frame time
+struct LodStats
+{
+    int trianglesDrawn;
+    int trianglesSaved;     // compared to drawing every shape at its finest level
+    int levelChanges;
+};
+
+class LodCache
+{
+    public:
+
+        // The cache shared by every shape in the scene
+        static LodCache& shared();
+
+        // Return the chain for this primitive, halving the tessellation per level down to the given minimum.
+        // Levels come from the MeshCache, so a level that matches another shape's tessellation is shared,
+        // and like any cached mesh they are generated by MeshCache::build().
+        LodChain* acquire(PrimitiveType type, int numSlices, int numSectors, int minSlices, int minSectors, MeshGenerator generate, LodErrorFunction error);
+
+    private:
+        std::map<MeshKey, LodChain> chains;
+};
+
+LodCache& LodCache::shared() {
+    static LodCache cache;
+    return cache;
+}
+
+LodChain* LodCache::acquire(PrimitiveType type, int numSlices, int numSectors, int minSlices, int minSectors, MeshGenerator generate, LodErrorFunction error) {
+    MeshKey key = {type, numSlices, numSectors};
+    std::map<MeshKey, LodChain>::iterator found = chains.find(key);
+    if (found != chains.end()) {
+        return &found->second;
+    }
+
+    LodChain &chain = chains[key];
+    int slices = numSlices;
+    int sectors = numSectors;
+    for (int level = 0; level < LOD_MAX_LEVELS; level++) {
+        chain.levels.push_back(MeshCache::shared().acquire(type, slices, sectors, generate));
+        chain.errors.push_back(error(slices, sectors));
+
+        int nextSlices = std::min(slices, std::max(slices / 2, minSlices));
+        int nextSectors = std::min(sectors, std::max(sectors / 2, minSectors));
+        if (nextSlices == slices && nextSectors == sectors) {
+            break;
+        }
+        slices = nextSlices;
+        sectors = nextSectors;
+    }
+    return &chain;
+}
+
+// Pick the level to draw an object with, starting from the level it used last frame.
+// Works for perspective and orthographic projections: the pixels per world unit come from
+// the clip w of the nearest point of the bounding sphere, which is 1 for orthographic.
+// The finest level's bounding sphere stands in for every level, since coarser ones lie inside it.
+int selectLodLevel(const LodChain &chain, int current, const glm::mat4 &modelView, const glm::mat4 &projection, float viewportHeight) {
+    const Mesh* finest = chain.levels[0];
+    // The largest axis scale makes the error conservative for non-uniformly scaled objects
+    float scale = std::max(glm::length(glm::vec3(modelView[0])), std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+    glm::vec4 center = modelView * glm::vec4(finest->bounds.center, 1.0f);
+
+    // The camera looks down -z, so the nearest point of the sphere is towards +z
+    glm::vec4 nearest = center + glm::vec4(0.0f, 0.0f, finest->bounds.radius * scale, 0.0f);
+    float w = (projection * nearest).w;
+    if (w <= 0.0f) {
+        // The camera is inside the bounding sphere
+        return 0;
+    }
+    float pixelsPerUnit = std::fabs(projection[1][1]) * 0.5f * viewportHeight / w;
+
+    int last = chain.levels.size() - 1;
+    int level = std::min(std::max(current, 0), last);
+    while (level > 0 && chain.errors[level] * scale * pixelsPerUnit > LOD_PIXEL_ERROR) {
+        level--;
+    }
+    while (level < last && chain.errors[level + 1] * scale * pixelsPerUnit <= LOD_PIXEL_ERROR * LOD_HYSTERESIS) {
+        level++;
+    }
+    return level;
+}
+#endif
@@ -0,0 +1,138 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+// Must match MAX_MATERIALS and MAX_TEXTURE_UNITS in multiLight.fs
+const int MAX_MATERIALS = 16;
+const int MAX_TEXTURE_UNITS = 8;
+
+class Material
+{
+    public:
+
+        // constructor gets the base color of the object, defaulting to texture unit 0
+        Material(float colorR = 1.0f, float colorG = 1.0f, float colorB = 1.0f);
+
+        // Set which texture units and shininess this material samples with
+        void setTextures(int diffuseUnit, int specularUnit, float shininessValue);
+
+        // Below 1 the material is see-through, and objects using it are drawn after every opaque one
+        void setOpacity(float opacityValue);
+
+        bool transparent() const;
+
+        bool operator==(const Material &other) const;
+
+        glm::vec3 color;
+        int diffuse;
+        int specular;
+        float shininess;
+        float opacity;
+};
+
+Material::Material(float colorR, float colorG, float colorB) {
+    color = glm::vec3(colorR, colorG, colorB);
+    diffuse = 0;
+    specular = 0;
+    shininess = 32.0f;
+    opacity = 1.0f;
+}
+
+void Material::setTextures(int diffuseUnit, int specularUnit, float shininessValue) {
+    diffuse = diffuseUnit;
+    specular = specularUnit;
+    shininess = shininessValue;
+}
+
+void Material::setOpacity(float opacityValue) {
+    opacity = opacityValue;
+}
+
+bool Material::transparent() const {
+    return opacity < 1.0f;
+}
+
+bool Material::operator==(const Material &other) const {
+    return color == other.color && diffuse == other.diffuse && specular == other.specular && shininess == other.shininess && opacity == other.opacity;
+}
+
+
+// The table of distinct materials in the scene. Each material is uploaded to the
+// materials[] uniform array once; draws only pass the index of the one they use.
+class MaterialLibrary
+{
+    public:
+
+        // The library shared by every shape in the scene
+        static MaterialLibrary& shared();
+
+        MaterialLibrary();
+
+        // Return the index of this material, adding it to the table if it is new
+        int add(const Material &material);
+
+        // Upload the table to the shader if it changed since this shader last saw it
+        void upload(Shader &shader);
+
+        std::vector<Material> materials;
+
+    private:
+        // Bumped on every add, so each program knows whether its copy is stale
+        int version;
+        std::map<unsigned int, int> uploadedVersion;
+};
+
+MaterialLibrary& MaterialLibrary::shared() {
+    static MaterialLibrary library;
+    return library;
+}
+
+MaterialLibrary::MaterialLibrary() {
+    version = 0;
+}
+
+int MaterialLibrary::add(const Material &material) {
+    for (unsigned int i = 0; i < materials.size(); i++) {
+        if (materials[i] == material) {
+            return i;
+        }
+    }
+    if ((int)materials.size() == MAX_MATERIALS) {
+        std::cout << "ERROR::MATERIAL::TOO_MANY_MATERIALS" << std::endl;
+        return 0;
+    }
+    materials.push_back(material);
+    version++;
+    return materials.size() - 1;
+}
+
+void MaterialLibrary::upload(Shader &shader) {
+    std::map<unsigned int, int>::iterator found = uploadedVersion.find(shader.ID);
+    if (found != uploadedVersion.end() && found->second == version) {
+        return;
+    }
+
+    // Every texture keeps its own unit, so the sampler array simply maps unit i to i
+    shader.use();
+    for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        shader.setInt("textureUnits[" + std::to_string(unit) + "]", unit);
+    }
+    for (unsigned int i = 0; i < materials.size(); i++) {
+        std::string name = "materials[" + std::to_string(i) + "]";
+        shader.setVec3(name + ".color", materials[i].color);
+        shader.setInt(name + ".diffuse", materials[i].diffuse);
+        shader.setInt(name + ".specular", materials[i].specular);
+        shader.setFloat(name + ".shininess", materials[i].shininess);
+        shader.setFloat(name + ".opacity", materials[i].opacity);
+    }
+    uploadedVersion[shader.ID] = version;
+}
+#endif
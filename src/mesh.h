@@ -0,0 +1,732 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bounds.h"
+#include "glstate.h"
+#include "meshfile.h"
+#include "meshoptimizer.h"
+#include "vertexformat.h"
+#include "workerpool.h"
+
+// The primitive shapes that can be generated as unit meshes
+enum PrimitiveType {
+    PRIMITIVE_CYLINDER,
+    PRIMITIVE_CUBE,
+    PRIMITIVE_CONE,
+    PRIMITIVE_PLANE,
+    PRIMITIVE_SPHERE
+};
+
+// Names of the primitives, in PrimitiveType order, for log output
+const char* PRIMITIVE_NAMES[] = {"cylinder", "cube", "cone", "plane", "sphere"};
+
+// Bytes in one index of the given GL index type
+int indexTypeSize(GLenum indexType) {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+// Strips need the restart index set to every bit of their index type; lists never contain it
+void setPrimitiveRestart(GLenum primitive, GLenum indexType) {
+    if (primitive == GL_TRIANGLE_STRIP) {
+        GLState::shared().enable(GL_PRIMITIVE_RESTART);
+        GLState::shared().primitiveRestartIndex(indexType == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+    }
+}
+
+class Mesh
+{
+    public:
+
+        // constructor gets the number of floats in each vertex attribute, in attribute location order
+        Mesh(std::vector<int> attributeSizes = std::vector<int>());
+
+        // Initialize the OpenGL constructs for this mesh
+        void init();
+
+        // Point the vertex attributes of the currently bound VAO at this mesh's buffers
+        void bindAttributes();
+
+        // Merge bit-identical vertices and rebuild the index buffer to match.
+        // A mesh without indices is treated as a plain triangle list.
+        void weld();
+
+        // Reorder triangles for the vertex cache and overdraw, then vertices for fetch order.
+        // Writes the ACMR before and after to log under the given name.
+        void optimize(const std::string &name, std::ostream &log = std::cout);
+
+        // Rewrite the triangle list as strips joined by primitive restart, if that takes fewer indices.
+        // Must run after weld() and optimize(), which only understand lists.
+        void stripify(const std::string &name, std::ostream &log = std::cout);
+
+        // Find the box and sphere around the vertex positions, for generators that do not set bounds themselves
+        void computeBounds();
+
+        // Use 16-bit indices whenever every vertex can be addressed by one; 0xFFFF is kept for restart
+        void chooseIndexType();
+
+        // The indices converted to indexType, ready to upload
+        std::vector<unsigned char> packedIndices();
+
+        // Draw the mesh
+        void draw();
+
+        // Issue the draw call alone, for callers that have already bound VAOc
+        void drawElements();
+
+        // Number of floats in one vertex
+        int stride();
+
+        std::vector<float> vertices;
+        std::vector<int> indices;
+        std::vector<int> attributes;
+        int vertexSize;
+        int indexSize;
+        int vertexCount;
+        int triangleCount;
+        unsigned int VBOc, VAOc, EBOc;
+
+        // GL_TRIANGLES or GL_TRIANGLE_STRIP, and GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        GLenum primitive;
+        GLenum indexType;
+
+        // Generators set this for meshes that are mostly long bands, such as cylinder walls
+        bool preferStrips;
+
+        // Box and sphere around the mesh in its own space; a radius of 0 means not known yet
+        Bounds bounds;
+
+        // How the vertices are stored on the GPU; the CPU copy is always floats
+        VertexFormat format;
+
+        // Small number unique to each MeshCache mesh, for sort keys; 0 for meshes outside the cache
+        int id;
+
+        // Where this mesh starts inside its buffers; non-zero when sub-allocated from a GeometryPool
+        int baseVertex;
+        int indexOffset; // in bytes
+};
+
+Mesh::Mesh(std::vector<int> attributeSizes) {
+    attributes = attributeSizes;
+    vertexSize = 0;
+    indexSize = 0;
+    vertexCount = 0;
+    triangleCount = 0;
+    VBOc = VAOc = EBOc = 0;
+    format = VERTEX_FORMAT_FLOAT;
+    primitive = GL_TRIANGLES;
+    indexType = GL_UNSIGNED_INT;
+    preferStrips = false;
+    bounds = boxBounds(glm::vec3(0.0f), glm::vec3(0.0f), 0.0f);
+    id = 0;
+    baseVertex = 0;
+    indexOffset = 0;
+}
+
+void Mesh::init() {
+    vertexSize = vertices.size();
+    indexSize = indices.size();
+    vertexCount = vertexSize / stride();
+    chooseIndexType();
+    std::vector<unsigned char> packed = packedIndices();
+
+    // Generate one vertex array
+    glGenVertexArrays(1, &VAOc);
+
+    // Generate one vertex and element buffer
+    glGenBuffers(1, &VBOc);
+    glGenBuffers(1, &EBOc);
+
+    GLState::shared().bindVertexArray(VAOc);
+
+    // Bind the VBO buffer to the GL_ARRAY_BUFFER buffer object
+    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
+
+    // **Bind the EBO buffer to ELEMENT_ARRAY_BUFFER object
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
+
+    // Add the triangle vertices to the buffer
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+    // **Add the index data to the buffer
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+
+    // Describe where to find the vertex attributes
+    bindAttributes();
+}
+
+void Mesh::bindAttributes() {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
+    bindVertexFormat(format, attributes);
+}
+
+void Mesh::draw() {
+    GLState::shared().bindVertexArray(VAOc);
+    drawElements();
+}
+
+void Mesh::drawElements() {
+    setPrimitiveRestart(primitive, indexType);
+    glDrawElementsBaseVertex(primitive, indexSize, indexType, (void*)(intptr_t)indexOffset, baseVertex);
+}
+
+void Mesh::weld() {
+    int floats = stride();
+    int count = vertices.size() / floats;
+    if (indices.empty()) {
+        for (int i = 0; i < count; i++) {
+            indices.push_back(i);
+        }
+    }
+
+    // Hash each vertex's raw bits; equal hashes are confirmed with a full compare
+    std::unordered_multimap<uint64_t, int> seen;
+    std::vector<float> welded;
+    std::vector<int> remap(count);
+    for (int v = 0; v < count; v++) {
+        const float* vertex = &vertices[v * floats];
+        uint64_t hash = 14695981039346656037ULL;
+        const unsigned char* bytes = (const unsigned char*)vertex;
+        for (unsigned int b = 0; b < floats * sizeof(float); b++) {
+            hash = (hash ^ bytes[b]) * 1099511628211ULL;
+        }
+
+        remap[v] = -1;
+        std::pair<std::unordered_multimap<uint64_t, int>::iterator, std::unordered_multimap<uint64_t, int>::iterator> range = seen.equal_range(hash);
+        for (std::unordered_multimap<uint64_t, int>::iterator it = range.first; it != range.second; ++it) {
+            if (memcmp(&welded[it->second * floats], vertex, floats * sizeof(float)) == 0) {
+                remap[v] = it->second;
+                break;
+            }
+        }
+        if (remap[v] < 0) {
+            remap[v] = welded.size() / floats;
+            welded.insert(welded.end(), vertex, vertex + floats);
+            seen.insert(std::make_pair(hash, remap[v]));
+        }
+    }
+
+    for (unsigned int i = 0; i < indices.size(); i++) {
+        indices[i] = remap[indices[i]];
+    }
+    vertices = welded;
+    triangleCount = indices.size() / 3;
+}
+
+void Mesh::optimize(const std::string &name, std::ostream &log) {
+    int floats = stride();
+    int count = vertices.size() / floats;
+    float before = computeACMR(indices, count);
+
+    std::vector<int> reordered = indices;
+    std::vector<int> clusterStarts;
+    optimizeVertexCache(reordered, count, clusterStarts);
+
+    // Only keep the overdraw order if it costs little vertex cache efficiency
+    std::vector<int> sorted = reordered;
+    optimizeOverdraw(sorted, vertices, floats, clusterStarts);
+    if (computeACMR(sorted, count) <= computeACMR(reordered, count) * OVERDRAW_THRESHOLD) {
+        reordered = sorted;
+    }
+
+    // Generated meshes are often ordered well already; never make one worse
+    if (computeACMR(reordered, count) < before) {
+        indices = reordered;
+    }
+    optimizeVertexFetch(indices, vertices, floats);
+
+    float after = computeACMR(indices, vertices.size() / floats);
+    log << "Mesh " << name << ": ACMR " << before << " -> " << after << std::endl;
+}
+
+void Mesh::stripify(const std::string &name, std::ostream &log) {
+    std::vector<int> strips = stripifyTriangles(indices);
+    if (strips.size() < indices.size()) {
+        log << "Mesh " << name << ": strips use " << strips.size() << " of " << indices.size() << " indices" << std::endl;
+        indices = strips;
+        primitive = GL_TRIANGLE_STRIP;
+    }
+}
+
+void Mesh::computeBounds() {
+    // Centered on the box around the positions; not the tightest sphere, but close for convex shapes
+    int floats = stride();
+    glm::vec3 low(0.0f), high(0.0f);
+    for (unsigned int v = 0; v < vertices.size(); v += floats) {
+        glm::vec3 position(vertices[v], vertices[v + 1], vertices[v + 2]);
+        low = v == 0 ? position : glm::min(low, position);
+        high = v == 0 ? position : glm::max(high, position);
+    }
+    bounds = boxBounds(low, high, 0.0f);
+    for (unsigned int v = 0; v < vertices.size(); v += floats) {
+        glm::vec3 position(vertices[v], vertices[v + 1], vertices[v + 2]);
+        bounds.radius = std::max(bounds.radius, glm::length(position - bounds.center));
+    }
+}
+
+void Mesh::chooseIndexType() {
+    indexType = (int)(vertices.size() / stride()) <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+std::vector<unsigned char> Mesh::packedIndices() {
+    std::vector<unsigned char> packed(indices.size() * indexTypeSize(indexType));
+    if (indexType == GL_UNSIGNED_SHORT) {
+        unsigned short* target = (unsigned short*)packed.data();
+        for (unsigned int i = 0; i < indices.size(); i++) {
+            // PRIMITIVE_RESTART (-1) wraps to 0xFFFF here, and to 0xFFFFFFFF for 32-bit indices
+            target[i] = (unsigned short)indices[i];
+        }
+    } else {
+        memcpy(packed.data(), indices.data(), packed.size());
+    }
+    return packed;
+}
+
+int Mesh::stride() {
+    int floats = 0;
+    for (int size : attributes) {
+        floats += size;
+    }
+    return floats;
+}
+
+
+// One shared vertex buffer, index buffer and VAO that many meshes are sub-allocated from.
+// Every mesh is stored in the pool's vertex layout; attributes a mesh lacks are filled with zeros.
+// A compact pool quantizes the vertices on upload and expects the {3, 0, 2, 3} float layout.
+class GeometryPool
+{
+    public:
+
+        // constructor gets the vertex layout shared by every mesh in the pool
+        GeometryPool(std::vector<int> attributeSizes);
+
+        // Choose how vertices are stored; only possible before the first mesh is added
+        void setFormat(VertexFormat vertexFormat);
+
+        // Copy the mesh into the shared buffers and point it at its sub-allocation
+        void add(Mesh &mesh);
+
+        // The CPU half of add(): convert the mesh to the pool layout and produce the bytes to upload.
+        // Touches no GL state, so it may run on any thread.
+        void pack(Mesh &mesh, std::vector<unsigned char> &vertexData, std::vector<unsigned char> &indexData);
+
+        // The GL half of add(): upload packed data and point the mesh at it. The mesh's primitive,
+        // index type and counts must already describe the data.
+        void upload(Mesh &mesh, const void* vertexData, int meshVertices, const void* indexData, int meshIndexBytes);
+
+        // The vertex layout every pooled mesh is stored in
+        const std::vector<int>& layout();
+
+        // Draw several pooled meshes, with one call per primitive and index type
+        void multiDraw(const std::vector<Mesh*> &meshes);
+
+        unsigned int VBOc, VAOc, EBOc;
+
+        VertexFormat format;
+
+    private:
+        std::vector<int> attributes;
+        int stride;
+        int vertexBytes;
+        int vertexCount, vertexCapacity;
+        int indexBytes, indexCapacity; // in bytes, since meshes may use different index types
+
+        // Grow a buffer to hold at least the given number of bytes, keeping its name and contents
+        void grow(unsigned int buffer, int usedBytes, int newBytes);
+};
+
+GeometryPool::GeometryPool(std::vector<int> attributeSizes) {
+    attributes = attributeSizes;
+    stride = 0;
+    for (int size : attributes) {
+        stride += size;
+    }
+    format = VERTEX_FORMAT_FLOAT;
+    vertexBytes = vertexFormatSize(format, attributes);
+    vertexCount = vertexCapacity = 0;
+    indexBytes = indexCapacity = 0;
+    VBOc = VAOc = EBOc = 0;
+}
+
+void GeometryPool::setFormat(VertexFormat vertexFormat) {
+    if (vertexCount > 0) {
+        std::cout << "ERROR::GEOMETRY_POOL::FORMAT_CHANGED_AFTER_UPLOAD" << std::endl;
+        return;
+    }
+    format = vertexFormat;
+    vertexBytes = vertexFormatSize(format, attributes);
+}
+
+void GeometryPool::grow(unsigned int buffer, int usedBytes, int newBytes) {
+    unsigned int scratch;
+    glGenBuffers(1, &scratch);
+
+    // Park the current contents in a scratch buffer while the pool buffer is reallocated
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+    glBufferData(GL_COPY_WRITE_BUFFER, usedBytes, NULL, GL_STATIC_COPY);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+
+    glBufferData(GL_COPY_READ_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+
+    glDeleteBuffers(1, &scratch);
+}
+
+void GeometryPool::add(Mesh &mesh) {
+    std::vector<unsigned char> vertexData, indexData;
+    pack(mesh, vertexData, indexData);
+    upload(mesh, vertexData.data(), mesh.vertexCount, indexData.data(), indexData.size());
+}
+
+void GeometryPool::pack(Mesh &mesh, std::vector<unsigned char> &vertexData, std::vector<unsigned char> &indexData) {
+    // Repack the mesh into the pool layout, zero filling attributes it does not have
+    int meshStride = mesh.stride();
+    int meshVertices = mesh.vertices.size() / meshStride;
+    std::vector<float> packed(meshVertices * stride, 0.0f);
+    for (int v = 0; v < meshVertices; v++) {
+        int source = v * meshStride;
+        int target = v * stride;
+        for (unsigned int a = 0; a < attributes.size() && a < mesh.attributes.size(); a++) {
+            for (int c = 0; c < mesh.attributes[a] && c < attributes[a]; c++) {
+                packed[target + c] = mesh.vertices[source + c];
+            }
+            source += mesh.attributes[a];
+            target += attributes[a];
+        }
+    }
+
+    // The index type depends on the vertex count, which the repacked mesh is measured by
+    mesh.vertices = packed;
+    mesh.attributes = attributes;
+    mesh.format = format;
+    mesh.vertexSize = mesh.vertices.size();
+    mesh.vertexCount = meshVertices;
+    mesh.indexSize = mesh.indices.size();
+    mesh.chooseIndexType();
+    indexData = mesh.packedIndices();
+
+    if (format == VERTEX_FORMAT_COMPACT) {
+        std::vector<CompactVertex> compact = packCompactVertices(packed);
+        vertexData.assign((unsigned char*)compact.data(), (unsigned char*)(compact.data() + compact.size()));
+    } else {
+        vertexData.assign((unsigned char*)packed.data(), (unsigned char*)(packed.data() + packed.size()));
+    }
+}
+
+void GeometryPool::upload(Mesh &mesh, const void* vertexData, int meshVertices, const void* indexData, int meshIndexBytes) {
+    if (VAOc == 0) {
+        // Generate the shared vertex array and buffers the first time a mesh is added
+        glGenVertexArrays(1, &VAOc);
+        glGenBuffers(1, &VBOc);
+        glGenBuffers(1, &EBOc);
+
+        GLState::shared().bindVertexArray(VAOc);
+        Mesh layout(attributes);
+        layout.format = format;
+        layout.VBOc = VBOc;
+        layout.EBOc = EBOc;
+        layout.bindAttributes();
+        GLState::shared().bindVertexArray(0);
+    }
+
+    // Make room, doubling so that adding meshes one by one stays cheap
+    if (vertexCount + meshVertices > vertexCapacity) {
+        int capacity = std::max(vertexCapacity * 2, vertexCount + meshVertices);
+        grow(VBOc, vertexCount * vertexBytes, capacity * vertexBytes);
+        vertexCapacity = capacity;
+    }
+
+    // Indices must sit at a multiple of their own size, so keep every mesh 4-byte aligned
+    indexBytes = (indexBytes + 3) & ~3;
+    if (indexBytes + meshIndexBytes > indexCapacity) {
+        // The capacity stays a multiple of 4 too, so an aligned offset never passes the end of the buffer
+        int capacity = (std::max(indexCapacity * 2, indexBytes + meshIndexBytes) + 3) & ~3;
+        grow(EBOc, indexBytes, capacity);
+        indexCapacity = capacity;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
+    glBufferSubData(GL_ARRAY_BUFFER, vertexCount * vertexBytes, meshVertices * vertexBytes, vertexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBOc);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes, meshIndexBytes, indexData);
+
+    mesh.attributes = attributes;
+    mesh.format = format;
+    mesh.vertexCount = meshVertices;
+    mesh.baseVertex = vertexCount;
+    mesh.indexOffset = indexBytes;
+    mesh.VAOc = VAOc;
+    mesh.VBOc = VBOc;
+    mesh.EBOc = EBOc;
+
+    vertexCount += meshVertices;
+    indexBytes += meshIndexBytes;
+}
+
+const std::vector<int>& GeometryPool::layout() {
+    return attributes;
+}
+
+void GeometryPool::multiDraw(const std::vector<Mesh*> &meshes) {
+    // glMultiDrawElementsBaseVertex takes a single mode and index type, so group the meshes by both
+    std::map<std::pair<GLenum, GLenum>, std::vector<Mesh*> > groups;
+    for (Mesh* mesh : meshes) {
+        groups[std::make_pair(mesh->primitive, mesh->indexType)].push_back(mesh);
+    }
+
+    GLState::shared().bindVertexArray(VAOc);
+    for (std::map<std::pair<GLenum, GLenum>, std::vector<Mesh*> >::iterator group = groups.begin(); group != groups.end(); ++group) {
+        std::vector<GLsizei> counts;
+        std::vector<void*> offsets;
+        std::vector<GLint> baseVertices;
+        for (Mesh* mesh : group->second) {
+            counts.push_back(mesh->indexSize);
+            offsets.push_back((void*)(intptr_t)mesh->indexOffset);
+            baseVertices.push_back(mesh->baseVertex);
+        }
+        setPrimitiveRestart(group->first.first, group->first.second);
+        glMultiDrawElementsBaseVertex(group->first.first, counts.data(), group->first.second, offsets.data(), group->second.size(), baseVertices.data());
+    }
+}
+
+
+// Identifies one unit mesh: the primitive and its tessellation
+struct MeshKey
+{
+    PrimitiveType type;
+    int numSlices;
+    int numSectors;
+
+    bool operator<(const MeshKey &other) const {
+        if (type != other.type) return type < other.type;
+        if (numSlices != other.numSlices) return numSlices < other.numSlices;
+        return numSectors < other.numSectors;
+    }
+};
+
+// Signature of the functions that fill a unit mesh for a given tessellation
+typedef void (*MeshGenerator)(Mesh &mesh, int numSlices, int numSectors);
+
+// A mesh that has been asked for but not generated yet
+struct PendingMesh
+{
+    MeshKey key;
+    MeshGenerator generate;
+    Mesh* mesh;
+    std::ostringstream log;
+
+    // Set when the mesh is in the disk cache; otherwise the packed data is generated
+    const MeshFileEntry* stored;
+    std::vector<unsigned char> vertexData;
+    std::vector<unsigned char> indexData;
+};
+
+// Meshes are built in two phases: acquire() only records what is needed, then build() generates
+// every recorded mesh in parallel on the WorkerPool and uploads them on the calling thread,
+// which must own the GL context. With a disk cache, meshes stored there skip generation and are
+// uploaded straight from the mapped file; a mesh loaded that way keeps no CPU copy of its vertices.
+class MeshCache
+{
+    public:
+
+        // The cache shared by every shape in the scene
+        static MeshCache& shared();
+
+        // Return the unit mesh for this key. A new mesh stays empty until build() is called.
+        Mesh* acquire(PrimitiveType type, int numSlices, int numSectors, MeshGenerator generate);
+
+        // Generate every mesh acquired since the last build on all cores, then upload them to the pool
+        void build();
+
+        // Load meshes from this file and save newly generated ones to it; call before build()
+        void setDiskCache(const std::string &path);
+
+        // Number of distinct meshes that have been asked for
+        int size();
+
+        // Every cached mesh lives in this one pool
+        GeometryPool pool = GeometryPool({3, 0, 2, 3});
+
+    private:
+        std::map<MeshKey, Mesh> meshes;
+        std::vector<PendingMesh*> pending;
+
+        std::string diskCachePath;
+        MeshFile diskCache;
+
+        // Rewrite the disk cache with everything it held plus the meshes just generated
+        void saveDiskCache();
+};
+
+MeshCache& MeshCache::shared() {
+    static MeshCache cache;
+    return cache;
+}
+
+Mesh* MeshCache::acquire(PrimitiveType type, int numSlices, int numSectors, MeshGenerator generate) {
+    MeshKey key = {type, numSlices, numSectors};
+    std::map<MeshKey, Mesh>::iterator found = meshes.find(key);
+    if (found != meshes.end()) {
+        return &found->second;
+    }
+
+    // std::map never moves its elements, so the pointer handed out stays valid
+    Mesh &mesh = meshes[key];
+    // The map already holds this mesh, so ids start at 1 and leave 0 to meshes outside the cache
+    mesh.id = meshes.size();
+    PendingMesh* job = new PendingMesh();
+    job->key = key;
+    job->generate = generate;
+    job->mesh = &mesh;
+    job->stored = nullptr;
+    pending.push_back(job);
+    return &mesh;
+}
+
+void MeshCache::setDiskCache(const std::string &path) {
+    diskCachePath = path;
+    diskCache.open(path, pool.format, pool.layout(), vertexFormatSize(pool.format, pool.layout()));
+}
+
+void MeshCache::build() {
+    // Meshes already in the disk cache need no CPU work at all
+    std::map<MeshKey, const MeshFileEntry*> stored;
+    for (int i = 0; i < diskCache.meshCount(); i++) {
+        const MeshFileEntry &entry = diskCache.entry(i);
+        MeshKey key = {(PrimitiveType)entry.type, entry.numSlices, entry.numSectors};
+        stored[key] = &entry;
+    }
+    std::vector<PendingMesh*> generated;
+    for (PendingMesh* job : pending) {
+        std::map<MeshKey, const MeshFileEntry*>::iterator found = stored.find(job->key);
+        if (found != stored.end()) {
+            job->stored = found->second;
+        } else {
+            generated.push_back(job);
+        }
+    }
+
+    // CPU phase: each job only touches its own mesh, so they run in any order on any thread
+    WorkerPool::shared().parallelFor(generated.size(), [this, &generated](int i) {
+        PendingMesh* job = generated[i];
+        Mesh &mesh = *job->mesh;
+        std::string name = std::string(PRIMITIVE_NAMES[job->key.type]) + " " + std::to_string(job->key.numSlices) + "x" + std::to_string(job->key.numSectors);
+        job->generate(mesh, job->key.numSlices, job->key.numSectors);
+        mesh.weld();
+        mesh.optimize(name, job->log);
+        if (mesh.preferStrips) {
+            mesh.stripify(name, job->log);
+        }
+        if (mesh.bounds.radius <= 0.0f) {
+            mesh.computeBounds();
+        }
+        pool.pack(mesh, job->vertexData, job->indexData);
+    });
+
+    // GL phase: upload in the order the meshes were asked for, so the pool layout does not depend on timing
+    for (PendingMesh* job : pending) {
+        Mesh &mesh = *job->mesh;
+        if (job->stored != nullptr) {
+            const MeshFileEntry &entry = *job->stored;
+            mesh.primitive = entry.primitive;
+            mesh.indexType = entry.indexType;
+            mesh.indexSize = entry.indexCount;
+            mesh.triangleCount = entry.triangleCount;
+            mesh.bounds.min = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+            mesh.bounds.max = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+            mesh.bounds.center = glm::vec3(entry.boundingCenter[0], entry.boundingCenter[1], entry.boundingCenter[2]);
+            mesh.bounds.radius = entry.boundingRadius;
+            pool.upload(mesh, diskCache.at(entry.vertexOffset), entry.vertexCount, diskCache.at(entry.indexOffset), entry.indexBytes);
+        } else {
+            std::cout << job->log.str();
+            pool.upload(mesh, job->vertexData.data(), mesh.vertexCount, job->indexData.data(), job->indexData.size());
+        }
+    }
+
+    if (!diskCachePath.empty() && !generated.empty()) {
+        saveDiskCache();
+    }
+    for (PendingMesh* job : pending) {
+        delete job;
+    }
+    pending.clear();
+}
+
+void MeshCache::saveDiskCache() {
+    std::vector<MeshFileRecord> records;
+    std::map<MeshKey, bool> written;
+
+    // Keep what the file already held; those pointers stay valid until the file is closed below
+    for (int i = 0; i < diskCache.meshCount(); i++) {
+        const MeshFileEntry &entry = diskCache.entry(i);
+        MeshFileRecord record = {entry, diskCache.at(entry.vertexOffset), diskCache.at(entry.indexOffset)};
+        records.push_back(record);
+        MeshKey key = {(PrimitiveType)entry.type, entry.numSlices, entry.numSectors};
+        written[key] = true;
+    }
+    for (PendingMesh* job : pending) {
+        if (job->stored != nullptr || written.count(job->key) > 0) {
+            continue;
+        }
+        const Mesh &mesh = *job->mesh;
+        MeshFileRecord record;
+        memset(&record.entry, 0, sizeof(record.entry));
+        record.entry.type = job->key.type;
+        record.entry.numSlices = job->key.numSlices;
+        record.entry.numSectors = job->key.numSectors;
+        record.entry.primitive = mesh.primitive;
+        record.entry.indexType = mesh.indexType;
+        record.entry.vertexCount = mesh.vertexCount;
+        record.entry.indexCount = mesh.indexSize;
+        record.entry.triangleCount = mesh.triangleCount;
+        for (int axis = 0; axis < 3; axis++) {
+            record.entry.boundsMin[axis] = mesh.bounds.min[axis];
+            record.entry.boundsMax[axis] = mesh.bounds.max[axis];
+            record.entry.boundingCenter[axis] = mesh.bounds.center[axis];
+        }
+        record.entry.boundingRadius = mesh.bounds.radius;
+        record.entry.vertexBytes = job->vertexData.size();
+        record.entry.indexBytes = job->indexData.size();
+        record.vertexData = job->vertexData.data();
+        record.indexData = job->indexData.data();
+        records.push_back(record);
+    }
+
+    // Write beside the old file and swap it in, so an interrupted write never leaves a broken cache
+    std::string temporary = diskCachePath + ".tmp";
+    if (!MeshFile::write(temporary, pool.format, pool.layout(), records)) {
+        std::cout << "ERROR::MESH_CACHE::WRITE_FAILED " << temporary << std::endl;
+        std::remove(temporary.c_str());
+        return;
+    }
+    diskCache.close();
+    std::error_code error;
+    std::filesystem::rename(temporary, diskCachePath, error);
+    if (error) {
+        std::cout << "ERROR::MESH_CACHE::RENAME_FAILED " << diskCachePath << std::endl;
+    }
+    diskCache.open(diskCachePath, pool.format, pool.layout(), vertexFormatSize(pool.format, pool.layout()));
+}
+
+int MeshCache::size() {
+    return meshes.size();
+}
+#endif
@@ -0,0 +1,224 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "filemapping.h"
+
+// "MSHC" read as a little endian integer; a file written with the other byte order fails the check
+const uint32_t MESH_FILE_MAGIC = 0x4348534D;
+
+// Bump whenever a generator, the mesh optimizer or the vertex packing changes its output, so old files are ignored
+const uint32_t MESH_FILE_VERSION = 2;
+
+const int MESH_FILE_MAX_ATTRIBUTES = 8;
+
+// Every block of vertex or index data starts on this boundary
+const int MESH_FILE_ALIGNMENT = 16;
+
+// Start of the file. A file whose vertex layout differs from the pool's is ignored.
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexFormat;
+    uint32_t attributeCount;
+    int32_t attributes[MESH_FILE_MAX_ATTRIBUTES];
+    uint32_t meshCount;
+    uint32_t reserved;
+};
+static_assert(sizeof(MeshFileHeader) == 56, "MeshFileHeader is written as is and must not change size");
+
+// One stored mesh: the generator parameters it was made with, how to draw it, and where its data is.
+// The data is exactly what the GeometryPool uploads, so it goes straight from the file to the GPU.
+struct MeshFileEntry
+{
+    int32_t type;
+    int32_t numSlices;
+    int32_t numSectors;
+    uint32_t primitive;
+    uint32_t indexType;
+    int32_t vertexCount;
+    int32_t indexCount;
+    int32_t triangleCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    float boundingCenter[3];
+    float boundingRadius;
+    uint64_t vertexOffset;      // from the start of the file
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+};
+static_assert(sizeof(MeshFileEntry) == 104, "MeshFileEntry is written as is and must not change size");
+
+// A mesh to write: its entry, whose offsets write() fills in, and its data
+struct MeshFileRecord
+{
+    MeshFileEntry entry;
+    const void* vertexData;
+    const void* indexData;
+};
+
+// A mesh file mapped read-only into memory
+class MeshFile
+{
+    public:
+
+        ~MeshFile();
+
+        // Map the file. Returns false and stays empty if it is missing, damaged, from another
+        // MESH_FILE_VERSION or stores a different vertex layout. vertexStride is the bytes per
+        // vertex of that layout, which every stored vertex block must agree with.
+        bool open(const std::string &path, uint32_t vertexFormat, const std::vector<int> &attributes, uint64_t vertexStride);
+
+        // Unmap the file; pointers from at() are invalid afterwards
+        void close();
+
+        // Stored meshes
+        int meshCount();
+        const MeshFileEntry& entry(int i);
+
+        // The mapped bytes at this offset in the file
+        const void* at(uint64_t offset);
+
+        // Write the records as a new file at path
+        static bool write(const std::string &path, uint32_t vertexFormat, const std::vector<int> &attributes, std::vector<MeshFileRecord> &records);
+
+    private:
+        FileMapping view;
+
+        // Check the header, that every entry's sizes match its counts and that its data lies inside the file
+        bool valid(uint32_t vertexFormat, const std::vector<int> &attributes, uint64_t vertexStride);
+
+        // True if bytes starting at offset lie inside the file, without overflowing
+        bool contains(uint64_t offset, uint64_t bytes);
+};
+
+MeshFile::~MeshFile() {
+    close();
+}
+
+bool MeshFile::open(const std::string &path, uint32_t vertexFormat, const std::vector<int> &attributes, uint64_t vertexStride) {
+    close();
+    if (!mapFile(path, view) || !valid(vertexFormat, attributes, vertexStride)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MeshFile::close() {
+    unmapFile(view);
+}
+
+bool MeshFile::contains(uint64_t offset, uint64_t bytes) {
+    return offset <= view.size && bytes <= view.size - offset;
+}
+
+bool MeshFile::valid(uint32_t vertexFormat, const std::vector<int> &attributes, uint64_t vertexStride) {
+    if (view.size < sizeof(MeshFileHeader)) {
+        return false;
+    }
+    const MeshFileHeader* header = (const MeshFileHeader*)view.data;
+    if (header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION || header->vertexFormat != vertexFormat) {
+        return false;
+    }
+    if (header->attributeCount != attributes.size()) {
+        return false;
+    }
+    for (unsigned int a = 0; a < attributes.size(); a++) {
+        if (header->attributes[a] != attributes[a]) {
+            return false;
+        }
+    }
+    if (sizeof(MeshFileHeader) + (uint64_t)header->meshCount * sizeof(MeshFileEntry) > view.size) {
+        return false;
+    }
+    for (int i = 0; i < meshCount(); i++) {
+        const MeshFileEntry &stored = entry(i);
+        if (stored.vertexCount < 0 || stored.indexCount < 0) {
+            return false;
+        }
+        if (stored.indexType != GL_UNSIGNED_SHORT && stored.indexType != GL_UNSIGNED_INT) {
+            return false;
+        }
+        // The loader uploads vertexCount vertices and indexBytes of indices, so both must match what is stored
+        uint64_t indexSize = stored.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        if (stored.vertexBytes != (uint64_t)stored.vertexCount * vertexStride || stored.indexBytes != (uint64_t)stored.indexCount * indexSize) {
+            return false;
+        }
+        if (!contains(stored.vertexOffset, stored.vertexBytes) || !contains(stored.indexOffset, stored.indexBytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int MeshFile::meshCount() {
+    return view.data != nullptr ? ((const MeshFileHeader*)view.data)->meshCount : 0;
+}
+
+const MeshFileEntry& MeshFile::entry(int i) {
+    return ((const MeshFileEntry*)(view.data + sizeof(MeshFileHeader)))[i];
+}
+
+const void* MeshFile::at(uint64_t offset) {
+    return view.data + offset;
+}
+
+bool MeshFile::write(const std::string &path, uint32_t vertexFormat, const std::vector<int> &attributes, std::vector<MeshFileRecord> &records) {
+    if ((int)attributes.size() > MESH_FILE_MAX_ATTRIBUTES) {
+        return false;
+    }
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == nullptr) {
+        return false;
+    }
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexFormat = vertexFormat;
+    header.attributeCount = attributes.size();
+    for (unsigned int a = 0; a < attributes.size(); a++) {
+        header.attributes[a] = attributes[a];
+    }
+    header.meshCount = records.size();
+
+    // Lay the data blocks out after the entry table
+    uint64_t offset = sizeof(MeshFileHeader) + records.size() * sizeof(MeshFileEntry);
+    for (MeshFileRecord &record : records) {
+        offset = (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+        record.entry.vertexOffset = offset;
+        offset += record.entry.vertexBytes;
+        offset = (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+        record.entry.indexOffset = offset;
+        offset += record.entry.indexBytes;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (MeshFileRecord &record : records) {
+        written = written && fwrite(&record.entry, sizeof(MeshFileEntry), 1, out) == 1;
+    }
+    const char padding[MESH_FILE_ALIGNMENT] = {0};
+    uint64_t position = sizeof(MeshFileHeader) + records.size() * sizeof(MeshFileEntry);
+    for (MeshFileRecord &record : records) {
+        written = written && fwrite(padding, 1, record.entry.vertexOffset - position, out) == record.entry.vertexOffset - position;
+        written = written && fwrite(record.vertexData, 1, record.entry.vertexBytes, out) == record.entry.vertexBytes;
+        position = record.entry.vertexOffset + record.entry.vertexBytes;
+        written = written && fwrite(padding, 1, record.entry.indexOffset - position, out) == record.entry.indexOffset - position;
+        written = written && fwrite(record.indexData, 1, record.entry.indexBytes, out) == record.entry.indexBytes;
+        position = record.entry.indexOffset + record.entry.indexBytes;
+    }
+    written = fclose(out) == 0 && written;
+    return written;
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef MESHGEN_H
+#define MESHGEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "simd.h"
+
+// Angles produced by rotation before the table is reseeded from cos and sin, which keeps the float drift negligible
+const int ANGLE_TABLE_RESEED = 64;
+
+// Write cos and sin of the count angles start, start + step, start + 2 step, ...
+// Four angles are produced at once by rotating the previous four by 4 step, so the
+// trigonometric functions are only called once per ANGLE_TABLE_RESEED angles.
+void angleTable(int count, double start, double step, float* cosines, float* sines) {
+    int i = 0;
+#ifdef USE_SSE
+    const __m128 rotateCos = _mm_set1_ps((float)cos(4.0 * step));
+    const __m128 rotateSin = _mm_set1_ps((float)sin(4.0 * step));
+    while (i + 4 <= count) {
+        __m128 c = _mm_setr_ps((float)cos(start + i * step), (float)cos(start + (i + 1) * step), (float)cos(start + (i + 2) * step), (float)cos(start + (i + 3) * step));
+        __m128 s = _mm_setr_ps((float)sin(start + i * step), (float)sin(start + (i + 1) * step), (float)sin(start + (i + 2) * step), (float)sin(start + (i + 3) * step));
+        int end = std::min(count, i + ANGLE_TABLE_RESEED);
+        for (; i + 4 <= end; i += 4) {
+            _mm_storeu_ps(cosines + i, c);
+            _mm_storeu_ps(sines + i, s);
+            __m128 nextC = _mm_sub_ps(_mm_mul_ps(c, rotateCos), _mm_mul_ps(s, rotateSin));
+            s = _mm_add_ps(_mm_mul_ps(s, rotateCos), _mm_mul_ps(c, rotateSin));
+            c = nextC;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        cosines[i] = cos(start + i * step);
+        sines[i] = sin(start + i * step);
+    }
+}
+
+// Points around the unit circle for numSlices slices. The tables hold numSlices + 1 entries;
+// the last repeats the first exactly so the seam vertices match and can be welded.
+void circleTable(int numSlices, std::vector<float> &cosines, std::vector<float> &sines) {
+    cosines.resize(numSlices + 1);
+    sines.resize(numSlices + 1);
+    angleTable(numSlices, 0.0, 2.0 * M_PI / numSlices, cosines.data(), sines.data());
+    cosines[numSlices] = cosines[0];
+    sines[numSlices] = sines[0];
+}
+
+// Floats in one generated vertex: position, texture coords and normal ({3, 0, 2, 3})
+const int GENERATED_VERTEX_FLOATS = 8;
+
+// Write one generated vertex in place and return where the next one goes
+inline float* writeVertex(float* out, float x, float y, float z, float u, float v, float normalX, float normalY, float normalZ) {
+    out[0] = x;
+    out[1] = y;
+    out[2] = z;
+    out[3] = u;
+    out[4] = v;
+    out[5] = normalX;
+    out[6] = normalY;
+    out[7] = normalZ;
+    return out + GENERATED_VERTEX_FLOATS;
+}
+#endif
@@ -0,0 +1,337 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Size of the simulated post-transform vertex cache, in vertices
+const int VERTEX_CACHE_SIZE = 16;
+
+// Index that ends one triangle strip and starts the next; uploaded with every bit set in the GPU index type
+const int PRIMITIVE_RESTART = -1;
+
+// Clusters whose local cache efficiency is within this factor of the whole cluster may be split for overdraw sorting
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+// Average cache miss ratio: vertex shader runs per triangle with a FIFO cache of the given size.
+// 3.0 is the worst case, around 0.5 to 0.7 is typical for a well ordered mesh.
+float computeACMR(const std::vector<int> &indices, int vertexCount, int cacheSize = VERTEX_CACHE_SIZE) {
+    if (indices.empty()) {
+        return 0.0f;
+    }
+    std::vector<int> cachedAt(vertexCount, -cacheSize - 1);
+    int misses = 0;
+    for (int index : indices) {
+        // A vertex is still cached if fewer than cacheSize misses happened since it was loaded
+        if (misses - cachedAt[index] > cacheSize) {
+            cachedAt[index] = misses;
+            misses++;
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+// Reorder the triangles for the post-transform vertex cache using Tipsify
+// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// The positions in the index buffer where the cache had to be restarted are written to clusterStarts.
+void optimizeVertexCache(std::vector<int> &indices, int vertexCount, std::vector<int> &clusterStarts, int cacheSize = VERTEX_CACHE_SIZE) {
+    int triangleCount = indices.size() / 3;
+
+    // Vertex to triangle adjacency, stored as one flat array with per-vertex offsets
+    std::vector<int> liveTriangles(vertexCount, 0);
+    for (int index : indices) {
+        liveTriangles[index]++;
+    }
+    std::vector<int> adjacencyStart(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; v++) {
+        adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+    }
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (unsigned int i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<int> deadEnds;
+    std::vector<int> output;
+    output.reserve(indices.size());
+    clusterStarts.clear();
+
+    int timeStamp = cacheSize + 1;
+    int cursor = 0;
+    int fanning = triangleCount > 0 ? indices[0] : -1;
+    bool restarted = true;
+
+    while (fanning >= 0) {
+        if (restarted) {
+            clusterStarts.push_back(output.size());
+            restarted = false;
+        }
+
+        // Emit every remaining triangle around the fanning vertex
+        std::vector<int> candidates;
+        for (int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+            int triangle = adjacency[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++) {
+                int v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (timeStamp - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = timeStamp;
+                    timeStamp++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // Next fanning vertex: the one that will stay in the cache longest while its triangles are emitted
+        int next = -1;
+        int best = -1;
+        for (int v : candidates) {
+            if (liveTriangles[v] > 0) {
+                int priority = 0;
+                if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                    priority = timeStamp - cacheTime[v];
+                }
+                if (priority > best) {
+                    best = priority;
+                    next = v;
+                }
+            }
+        }
+
+        // Dead end: back up through recently used vertices, then scan for any vertex with work left
+        while (next < 0 && !deadEnds.empty()) {
+            int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0) {
+                next = v;
+            }
+        }
+        if (next < 0) {
+            while (cursor < vertexCount && liveTriangles[cursor] == 0) {
+                cursor++;
+            }
+            if (cursor < vertexCount) {
+                next = cursor;
+                restarted = true;
+            }
+        }
+        fanning = next;
+    }
+    indices = output;
+}
+
+// Reorder the clusters produced by optimizeVertexCache so outward facing ones are drawn first and
+// occlude the rest. Hard clusters are split further wherever the split keeps the cache efficiency.
+void optimizeOverdraw(std::vector<int> &indices, const std::vector<float> &vertices, int stride, const std::vector<int> &clusterStarts, int cacheSize = VERTEX_CACHE_SIZE) {
+    int vertexCount = vertices.size() / stride;
+    if (indices.empty()) {
+        return;
+    }
+
+    // Split each hard cluster at the points where its running ACMR is already as good as the whole cluster
+    std::vector<int> starts;
+    for (unsigned int c = 0; c < clusterStarts.size(); c++) {
+        int begin = clusterStarts[c];
+        int end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : indices.size();
+        std::vector<int> cluster(indices.begin() + begin, indices.begin() + end);
+        float clusterACMR = computeACMR(cluster, vertexCount, cacheSize);
+
+        starts.push_back(begin);
+        std::vector<int> cachedAt(vertexCount, -cacheSize - 1);
+        int misses = 0;
+        int sinceSplit = 0;
+        for (int i = begin; i < end; i += 3) {
+            for (int corner = 0; corner < 3; corner++) {
+                int v = indices[i + corner];
+                if (misses - cachedAt[v] > cacheSize) {
+                    cachedAt[v] = misses;
+                    misses++;
+                }
+            }
+            sinceSplit++;
+            if (i + 3 < end && (float)misses / sinceSplit <= clusterACMR * OVERDRAW_THRESHOLD && sinceSplit >= 2) {
+                // Restart the simulated cache so the next piece is measured on its own
+                starts.push_back(i + 3);
+                std::fill(cachedAt.begin(), cachedAt.end(), -cacheSize - 1);
+                misses = 0;
+                sinceSplit = 0;
+            }
+        }
+    }
+
+    // Area weighted centroid and normal of every cluster, and of the whole mesh
+    std::vector<glm::vec3> centroids, normals;
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (unsigned int c = 0; c < starts.size(); c++) {
+        int begin = starts[c];
+        int end = c + 1 < starts.size() ? starts[c + 1] : indices.size();
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (int i = begin; i < end; i += 3) {
+            glm::vec3 p0 = glm::make_vec3(&vertices[indices[i] * stride]);
+            glm::vec3 p1 = glm::make_vec3(&vertices[indices[i + 1] * stride]);
+            glm::vec3 p2 = glm::make_vec3(&vertices[indices[i + 2] * stride]);
+            glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(cross) * 0.5f;
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids.push_back(area > 0.0f ? centroid / area : centroid);
+        normals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : normal);
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    std::vector<int> order(starts.size());
+    std::vector<float> outwardness(starts.size());
+    for (unsigned int c = 0; c < starts.size(); c++) {
+        order[c] = c;
+        outwardness[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return outwardness[a] > outwardness[b]; });
+
+    std::vector<int> output;
+    output.reserve(indices.size());
+    for (int c : order) {
+        int begin = starts[c];
+        int end = c + 1 < (int)starts.size() ? starts[c + 1] : indices.size();
+        output.insert(output.end(), indices.begin() + begin, indices.begin() + end);
+    }
+    indices = output;
+}
+
+// Renumber the vertices in the order the index buffer first uses them, so vertex fetches walk memory forwards
+void optimizeVertexFetch(std::vector<int> &indices, std::vector<float> &vertices, int stride) {
+    int vertexCount = vertices.size() / stride;
+    std::vector<int> remap(vertexCount, -1);
+    std::vector<float> ordered;
+    ordered.reserve(vertices.size());
+    int next = 0;
+    for (unsigned int i = 0; i < indices.size(); i++) {
+        int v = indices[i];
+        if (remap[v] < 0) {
+            remap[v] = next++;
+            ordered.insert(ordered.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+        }
+        indices[i] = remap[v];
+    }
+    // Vertices no triangle uses are dropped
+    vertices = ordered;
+}
+
+// Key for the edge from vertex a to vertex b
+uint64_t directedEdge(int a, int b) {
+    return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+}
+
+// Convert a triangle list into triangle strips joined by PRIMITIVE_RESTART, keeping the winding.
+// Strips are grown greedily from the triangles in list order, so most of the vertex cache order is kept.
+std::vector<int> stripifyTriangles(const std::vector<int> &indices) {
+    int triangleCount = indices.size() / 3;
+
+    // Directed edge to the triangles that have it in their winding order
+    std::unordered_multimap<uint64_t, int> edges;
+    for (int t = 0; t < triangleCount; t++) {
+        for (int corner = 0; corner < 3; corner++) {
+            uint64_t edge = directedEdge(indices[t * 3 + corner], indices[t * 3 + (corner + 1) % 3]);
+            edges.insert(std::make_pair(edge, t));
+        }
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<int> claimed(triangleCount, -1);
+    int attempt = 0;
+
+    // Grow a strip from one rotation of a start triangle. Triangles are claimed with the attempt number,
+    // so a strip never uses a triangle twice and trial strips need no undo.
+    auto grow = [&](int start, int rotation, std::vector<int> &strip, std::vector<int> &triangles) {
+        attempt++;
+        strip.clear();
+        triangles.clear();
+        for (int corner = 0; corner < 3; corner++) {
+            strip.push_back(indices[start * 3 + (rotation + corner) % 3]);
+        }
+        triangles.push_back(start);
+        claimed[start] = attempt;
+
+        while (true) {
+            // Odd triangles in a strip are wound backwards, so the shared edge flips direction each step
+            int p = strip[strip.size() - 2];
+            int q = strip[strip.size() - 1];
+            bool even = triangles.size() % 2 == 0;
+            uint64_t edge = even ? directedEdge(p, q) : directedEdge(q, p);
+
+            int next = -1;
+            int third = 0;
+            std::pair<std::unordered_multimap<uint64_t, int>::iterator, std::unordered_multimap<uint64_t, int>::iterator> range = edges.equal_range(edge);
+            for (std::unordered_multimap<uint64_t, int>::iterator it = range.first; it != range.second && next < 0; ++it) {
+                int t = it->second;
+                if (emitted[t] || claimed[t] == attempt) {
+                    continue;
+                }
+                for (int corner = 0; corner < 3; corner++) {
+                    if (directedEdge(indices[t * 3 + corner], indices[t * 3 + (corner + 1) % 3]) == edge) {
+                        next = t;
+                        third = indices[t * 3 + (corner + 2) % 3];
+                    }
+                }
+            }
+            if (next < 0) {
+                break;
+            }
+            strip.push_back(third);
+            triangles.push_back(next);
+            claimed[next] = attempt;
+        }
+    };
+
+    std::vector<int> output;
+    output.reserve(indices.size());
+    std::vector<int> strip, triangles;
+    for (int start = 0; start < triangleCount; start++) {
+        if (emitted[start]) {
+            continue;
+        }
+
+        // Try each edge of the start triangle as the first edge and keep the longest strip
+        int bestRotation = 0;
+        unsigned int bestLength = 0;
+        for (int rotation = 0; rotation < 3; rotation++) {
+            grow(start, rotation, strip, triangles);
+            if (triangles.size() > bestLength) {
+                bestLength = triangles.size();
+                bestRotation = rotation;
+            }
+        }
+        grow(start, bestRotation, strip, triangles);
+        for (int t : triangles) {
+            emitted[t] = true;
+        }
+
+        if (!output.empty()) {
+            output.push_back(PRIMITIVE_RESTART);
+        }
+        output.insert(output.end(), strip.begin(), strip.end());
+    }
+    return output;
+}
+#endif
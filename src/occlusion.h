@@ -0,0 +1,217 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "bounds.h"
+#include "shapes.h"
+
+// A query not refreshed for this many frames is too old to hide its object
+const int OCCLUSION_MAX_AGE = 2;
+
+// What occlusion culling did in one frame
+struct OcclusionStats
+{
+    int queried;    // box queries issued
+    int culled;     // draws skipped on the GPU because their box was hidden last time
+    int pending;    // queries whose result was not back yet at the start of the frame
+    int resolved;   // queries whose result came back this frame
+    int latency;    // frames between issue and result, summed over the resolved queries
+};
+
+// Each object's query and what is known of its last result
+struct OcclusionObject
+{
+    unsigned int queries[2];
+    int pending;        // slot issued and not yet read, or -1
+    int resolved;       // slot holding the last result, or -1; never reissued while it is
+    int issuedFrame;
+    int resolvedFrame;  // frame the resolved query was issued in
+    bool hidden;        // the resolved query saw no samples
+};
+
+// Hardware occlusion culling for the per-object path. After the frame is drawn, each visible
+// object's bounding box is drawn into the depth buffer inside a GL_ANY_SAMPLES_PASSED query,
+// with color and depth writes off. The next frame draws the object inside a conditional render
+// on that query, so a hidden object is skipped by the GPU without the CPU ever reading the result.
+// The CPU only polls whether results are available, for the counts; it never waits on them.
+// An object that comes into view from behind an occluder appears a frame late.
+class OcclusionCuller
+{
+    public:
+
+        OcclusionCuller();
+
+        // Read back the results that have arrived, without waiting, and start counting a new frame
+        void beginFrame();
+
+        // The object slot for a shape, created the first time it is asked for
+        int object(Shape* shape);
+
+        // Start and end a draw that the GPU skips if the object's last box query saw nothing
+        void beginDraw(int object);
+        void endDraw(int object);
+
+        // Query the boxes of the visible shapes against the finished depth buffer. bounds holds their
+        // world bounds in the same order, as ShapeCuller leaves them. boxShader needs only the Camera
+        // block and a model matrix, like lightSource.vs.
+        void queryBounds(Shader &boxShader, const std::vector<Shape*> &shapes, const BoundsBatch &bounds, const glm::vec3 &eye);
+
+        OcclusionStats frame;
+        OcclusionStats lastFrame;
+
+    private:
+        std::vector<OcclusionObject> objects;
+        std::unordered_map<Shape*, int> objectOfShape;
+        int frameNumber;
+        unsigned int VAOc, VBOc, EBOc;
+        bool conditional;   // whether the current draw is inside a conditional render
+
+        void createBox();
+};
+
+OcclusionCuller::OcclusionCuller() {
+    frame = {0, 0, 0, 0, 0};
+    lastFrame = frame;
+    frameNumber = 0;
+    VAOc = VBOc = EBOc = 0;
+    conditional = false;
+}
+
+void OcclusionCuller::createBox() {
+    // The cube from -1 to 1, scaled and moved onto each box when drawn
+    float corners[] = {
+        -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+        -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f
+    };
+    unsigned short faces[] = {
+        0, 2, 1, 0, 3, 2,   4, 5, 6, 4, 6, 7,   0, 1, 5, 0, 5, 4,
+        3, 6, 2, 3, 7, 6,   0, 4, 7, 0, 7, 3,   1, 2, 6, 1, 6, 5
+    };
+    glGenVertexArrays(1, &VAOc);
+    glGenBuffers(1, &VBOc);
+    glGenBuffers(1, &EBOc);
+    GLState::shared().bindVertexArray(VAOc);
+    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    GLState::shared().bindVertexArray(0);
+}
+
+int OcclusionCuller::object(Shape* shape) {
+    std::unordered_map<Shape*, int>::iterator found = objectOfShape.find(shape);
+    if (found != objectOfShape.end()) {
+        return found->second;
+    }
+    OcclusionObject object;
+    glGenQueries(2, object.queries);
+    object.pending = object.resolved = -1;
+    object.issuedFrame = object.resolvedFrame = 0;
+    object.hidden = false;
+    objects.push_back(object);
+    objectOfShape[shape] = objects.size() - 1;
+    return objects.size() - 1;
+}
+
+void OcclusionCuller::beginFrame() {
+    lastFrame = frame;
+    frame = {0, 0, 0, 0, 0};
+    frameNumber++;
+    for (OcclusionObject &object : objects) {
+        if (object.pending < 0) {
+            continue;
+        }
+        unsigned int query = object.queries[object.pending];
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            frame.pending++;
+            continue;
+        }
+        int samples = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT, &samples);
+        object.resolved = object.pending;
+        object.resolvedFrame = object.issuedFrame;
+        object.hidden = samples == 0;
+        object.pending = -1;
+        frame.resolved++;
+        frame.latency += frameNumber - object.issuedFrame;
+    }
+}
+
+void OcclusionCuller::beginDraw(int index) {
+    OcclusionObject &object = objects[index];
+    // An old result may predate a camera move that brought the object into view, so it is not trusted
+    conditional = object.resolved >= 0 && frameNumber - object.resolvedFrame <= OCCLUSION_MAX_AGE;
+    if (!conditional) {
+        return;
+    }
+    if (object.hidden) {
+        frame.culled++;
+    }
+    // The result is already back, so waiting for it costs nothing
+    glBeginConditionalRender(object.queries[object.resolved], GL_QUERY_WAIT);
+}
+
+void OcclusionCuller::endDraw(int) {
+    if (conditional) {
+        glEndConditionalRender();
+        conditional = false;
+    }
+}
+
+void OcclusionCuller::queryBounds(Shader &boxShader, const std::vector<Shape*> &shapes, const BoundsBatch &bounds, const glm::vec3 &eye) {
+    if (VAOc == 0) {
+        createBox();
+    }
+    boxShader.use();
+    Uniform<glm::mat4> modelUniform = boxShader.uniform<glm::mat4>(UNIFORM_MODEL);
+    GLState::shared().bindVertexArray(VAOc);
+    GLState::shared().depthMask(false);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    // The object's own surface touches its box, and must not hide it
+    glDepthFunc(GL_LEQUAL);
+
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        if (!shapes[i]->visible) {
+            continue;
+        }
+        OcclusionObject &object = objects[this->object(shapes[i])];
+        if (object.pending >= 0) {
+            continue;   // the last query is still in flight; its result will be used when it lands
+        }
+        Bounds box = bounds.get(i);
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        // Grown a little, so faces lying on the object's surface pass the depth test
+        glm::vec3 extent = (box.max - box.min) * 0.5f * 1.01f + glm::vec3(0.001f);
+
+        // From inside the box its front faces are clipped away and it would look hidden
+        if (glm::all(glm::lessThanEqual(glm::abs(eye - center), extent + glm::vec3(0.1f)))) {
+            object.resolved = -1;
+            continue;
+        }
+
+        object.pending = object.resolved == 0 ? 1 : 0;
+        object.issuedFrame = frameNumber;
+        boxShader.set(modelUniform, glm::scale(glm::translate(glm::mat4(1.0f), center), extent));
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, object.queries[object.pending]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, (void*)0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        frame.queried++;
+    }
+
+    glDepthFunc(GL_LESS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    GLState::shared().depthMask(true);
+}
+#endif
@@ -0,0 +1,317 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "bvh.h"
+
+// Levels below the root; a cell at the deepest level is 1/256 of the root's size
+const int OCTREE_MAX_DEPTH = 8;
+
+// A cell of the tree. Its loose box is twice the size of the cell, so an object whose centre lies
+// in the cell and whose extent is no more than half the cell's size always fits inside it.
+struct OctreeNode
+{
+    BvhNode box;        // the loose bounds, in the layout the box tests take
+    glm::vec3 center;
+    float halfSize;     // of the cell; the loose box reaches twice as far
+    int children[8];    // -1 where no object lives in that octant; indexed by x | y << 1 | z << 2
+    int parent;         // next free node while the node is in the pool's free list
+    int firstObject;    // head of the list of objects stored in this node
+    int objectCount;
+    int childCount;
+};
+
+// An object in the tree, linked into the list of the node holding it
+struct OctreeObject
+{
+    BvhNode box;        // leftFirst holds the caller's id
+    int node;           // -1 while the slot is in the pool's free list
+    int previous;
+    int next;           // next free slot while the slot is in the pool's free list
+};
+
+// A loose octree for objects that move every frame. Where an object goes depends only on its
+// centre and size, so inserting, moving and removing walk one path of at most OCTREE_MAX_DEPTH
+// nodes. Nodes and objects live in pools with free lists: once they have grown to the scene's
+// working size, moves never allocate. Objects outside the root cell are kept in the root, which
+// every query visits. Queries match BoundingVolumeHierarchy's, so a static and a dynamic index
+// can fill the same results.
+class LooseOctree
+{
+    public:
+
+        LooseOctree();
+
+        // Empty the tree and set the cell the root covers
+        void reset(const glm::vec3 &center, float halfSize);
+
+        // Add an object with the caller's id; returns its handle for move() and remove()
+        int insert(int id, const glm::vec3 &min, const glm::vec3 &max);
+
+        // Give an object new bounds, relinking it only if it now belongs in another node
+        void move(int handle, const glm::vec3 &min, const glm::vec3 &max);
+
+        void remove(int handle);
+
+        // Append the ids of the objects whose box is at least partly inside the frustum
+        void queryFrustum(const Frustum &frustum, std::vector<int> &results) const;
+
+        // Append the ids of the objects whose box comes within radius of center
+        void querySphere(const glm::vec3 &center, float radius, std::vector<int> &results) const;
+
+        int size() const;
+        int nodeCount() const;
+
+    private:
+        std::vector<OctreeNode> nodes;
+        std::vector<OctreeObject> objects;
+        int freeNode;
+        int freeObject;
+        int objectTotal;
+        int nodeTotal;
+
+        // The node an object with these bounds belongs in, creating the nodes on the way
+        int nodeFor(const glm::vec3 &min, const glm::vec3 &max);
+
+        int allocateNode(int parent, const glm::vec3 &center, float halfSize);
+
+        void link(int handle, int node);
+        void unlink(int handle);
+
+        // Return empty leaves to the pool, from node up towards the root
+        void prune(int node);
+
+        // Append every object under the node without testing it
+        void appendAll(int node, std::vector<int> &results) const;
+};
+
+LooseOctree::LooseOctree() {
+    reset(glm::vec3(0.0f), 64.0f);
+}
+
+void LooseOctree::reset(const glm::vec3 &center, float halfSize) {
+    nodes.clear();
+    objects.clear();
+    freeNode = freeObject = -1;
+    objectTotal = nodeTotal = 0;
+    allocateNode(-1, center, halfSize);
+}
+
+int LooseOctree::allocateNode(int parent, const glm::vec3 &center, float halfSize) {
+    int index = freeNode;
+    if (index >= 0) {
+        freeNode = nodes[index].parent;
+    } else {
+        index = nodes.size();
+        nodes.push_back(OctreeNode());
+    }
+    OctreeNode &node = nodes[index];
+    node.center = center;
+    node.halfSize = halfSize;
+    node.box.min = center - glm::vec3(2.0f * halfSize);
+    node.box.max = center + glm::vec3(2.0f * halfSize);
+    node.box.leftFirst = index;
+    node.box.count = 0;
+    for (int octant = 0; octant < 8; octant++) {
+        node.children[octant] = -1;
+    }
+    node.parent = parent;
+    node.firstObject = -1;
+    node.objectCount = 0;
+    node.childCount = 0;
+    nodeTotal++;
+    return index;
+}
+
+int LooseOctree::nodeFor(const glm::vec3 &min, const glm::vec3 &max) {
+    glm::vec3 center = (min + max) * 0.5f;
+    glm::vec3 extents = (max - min) * 0.5f;
+    float extent = glm::max(extents.x, glm::max(extents.y, extents.z));
+    const OctreeNode &root = nodes[0];
+    if (glm::any(glm::greaterThan(glm::abs(center - root.center), glm::vec3(root.halfSize)))) {
+        return 0;
+    }
+
+    // Step down while the object still fits in the next level's loose box
+    int index = 0;
+    for (int depth = 0; depth < OCTREE_MAX_DEPTH; depth++) {
+        float childHalf = nodes[index].halfSize * 0.5f;
+        if (extent > childHalf) {
+            break;
+        }
+        glm::vec3 cell = nodes[index].center;
+        int octant = (center.x >= cell.x ? 1 : 0) | (center.y >= cell.y ? 2 : 0) | (center.z >= cell.z ? 4 : 0);
+        int child = nodes[index].children[octant];
+        if (child < 0) {
+            glm::vec3 offset((octant & 1) ? childHalf : -childHalf, (octant & 2) ? childHalf : -childHalf, (octant & 4) ? childHalf : -childHalf);
+            child = allocateNode(index, cell + offset, childHalf);
+            nodes[index].children[octant] = child;
+            nodes[index].childCount++;
+        }
+        index = child;
+    }
+    return index;
+}
+
+void LooseOctree::link(int handle, int node) {
+    OctreeObject &object = objects[handle];
+    object.node = node;
+    object.previous = -1;
+    object.next = nodes[node].firstObject;
+    if (object.next >= 0) {
+        objects[object.next].previous = handle;
+    }
+    nodes[node].firstObject = handle;
+    nodes[node].objectCount++;
+}
+
+void LooseOctree::unlink(int handle) {
+    OctreeObject &object = objects[handle];
+    if (object.previous >= 0) {
+        objects[object.previous].next = object.next;
+    } else {
+        nodes[object.node].firstObject = object.next;
+    }
+    if (object.next >= 0) {
+        objects[object.next].previous = object.previous;
+    }
+    nodes[object.node].objectCount--;
+}
+
+void LooseOctree::prune(int index) {
+    while (index > 0 && nodes[index].objectCount == 0 && nodes[index].childCount == 0) {
+        int parent = nodes[index].parent;
+        for (int octant = 0; octant < 8; octant++) {
+            if (nodes[parent].children[octant] == index) {
+                nodes[parent].children[octant] = -1;
+            }
+        }
+        nodes[parent].childCount--;
+        nodes[index].parent = freeNode;
+        freeNode = index;
+        nodeTotal--;
+        index = parent;
+    }
+}
+
+int LooseOctree::insert(int id, const glm::vec3 &min, const glm::vec3 &max) {
+    int handle = freeObject;
+    if (handle >= 0) {
+        freeObject = objects[handle].next;
+    } else {
+        handle = objects.size();
+        objects.push_back(OctreeObject());
+    }
+    OctreeObject &object = objects[handle];
+    object.box.min = min;
+    object.box.max = max;
+    object.box.leftFirst = id;
+    object.box.count = 1;
+    link(handle, nodeFor(min, max));
+    objectTotal++;
+    return handle;
+}
+
+void LooseOctree::move(int handle, const glm::vec3 &min, const glm::vec3 &max) {
+    OctreeObject &object = objects[handle];
+    object.box.min = min;
+    object.box.max = max;
+    // Find the new node before pruning the old one, which may lie on its path
+    int node = nodeFor(min, max);
+    int old = object.node;
+    if (node == old) {
+        return;
+    }
+    unlink(handle);
+    link(handle, node);
+    prune(old);
+}
+
+void LooseOctree::remove(int handle) {
+    int old = objects[handle].node;
+    unlink(handle);
+    prune(old);
+    objects[handle].node = -1;
+    objects[handle].next = freeObject;
+    freeObject = handle;
+    objectTotal--;
+}
+
+void LooseOctree::appendAll(int index, std::vector<int> &results) const {
+    for (int handle = nodes[index].firstObject; handle >= 0; handle = objects[handle].next) {
+        results.push_back(objects[handle].box.leftFirst);
+    }
+    for (int octant = 0; octant < 8; octant++) {
+        if (nodes[index].children[octant] >= 0) {
+            appendAll(nodes[index].children[octant], results);
+        }
+    }
+}
+
+void LooseOctree::queryFrustum(const Frustum &frustum, std::vector<int> &results) const {
+    FrustumLanes lanes = frustumLanes(frustum);
+    // The root also holds the objects outside its cell, so it is always visited
+    int stack[8 * OCTREE_MAX_DEPTH + 1];
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int index = stack[--depth];
+        const OctreeNode &node = nodes[index];
+        if (index > 0) {
+            FrustumOverlap overlap = frustumOverlap(lanes, node.box);
+            if (overlap == FRUSTUM_OUTSIDE) {
+                continue;
+            }
+            if (overlap == FRUSTUM_INSIDE) {
+                appendAll(index, results);
+                continue;
+            }
+        }
+        for (int handle = node.firstObject; handle >= 0; handle = objects[handle].next) {
+            if (frustumOverlap(lanes, objects[handle].box) != FRUSTUM_OUTSIDE) {
+                results.push_back(objects[handle].box.leftFirst);
+            }
+        }
+        for (int octant = 0; octant < 8; octant++) {
+            if (node.children[octant] >= 0) {
+                stack[depth++] = node.children[octant];
+            }
+        }
+    }
+}
+
+void LooseOctree::querySphere(const glm::vec3 &center, float radius, std::vector<int> &results) const {
+    int stack[8 * OCTREE_MAX_DEPTH + 1];
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int index = stack[--depth];
+        const OctreeNode &node = nodes[index];
+        if (index > 0 && !sphereOverlapsBox(center, radius, node.box)) {
+            continue;
+        }
+        for (int handle = node.firstObject; handle >= 0; handle = objects[handle].next) {
+            if (sphereOverlapsBox(center, radius, objects[handle].box)) {
+                results.push_back(objects[handle].box.leftFirst);
+            }
+        }
+        for (int octant = 0; octant < 8; octant++) {
+            if (node.children[octant] >= 0) {
+                stack[depth++] = node.children[octant];
+            }
+        }
+    }
+}
+
+int LooseOctree::size() const {
+    return objectTotal;
+}
+
+int LooseOctree::nodeCount() const {
+    return nodeTotal;
+}
+#endif
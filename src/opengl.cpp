@@ -6,9 +6,16 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include <time.h>
 #include "shader.h"
 #include "shapes.h"
+#include "instancing.h"
+#include "ringbuffer.h"
+#include "indirect.h"
+#include "softocclusion.h"
+#include "renderqueue.h"
+#include "frameuniforms.h"
 
 using namespace std;
 
@@ -16,6 +23,9 @@ using namespace std;
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+// Current framebuffer height, which the LOD selection measures screen-space error in
+float viewportHeight = SCR_HEIGHT;
+
 // Initialize Camera
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 4.0f); // Camera is 3 units 'above' the scene
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);  // Camera is initially looking at the origin.
@@ -42,9 +52,31 @@ float scrollSensitivity = 0.001;
 // Start in perspective mode
 bool usePerspective = true;
 
+// Draw objects that share a mesh with one instanced call
+bool useInstancing = true;
+
+// Cull and draw the opaque objects on the GPU when the context supports it; instancing is the fallback
+bool useIndirect = true;
+
+// Skip objects hidden behind others, using last frame's bounding box queries; draws every object on its own
+bool useOcclusion = false;
+
+// Hide shapes behind the box-shaped ones with a small depth buffer drawn on the CPU; needs no GPU queries
+bool useSoftwareOcclusion = false;
+
+// Print the rendering counters once a second
+bool printStats = false;
+
+// Report the shape under the centre of the screen on the next frame
+bool pickRequested = false;
+
+// Store mesh vertices quantized to 16 bytes instead of 44; must be chosen before any shape is built
+const bool useCompactVertices = true;
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    viewportHeight = height;
 }  
 
 
@@ -110,8 +142,27 @@ void processInput(GLFWwindow *window)
         cameraPos += cameraSpeed * cameraUp;
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
         cameraPos -= cameraSpeed * cameraUp;
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+}
+
+// Mode toggles react to the press itself, so holding a key flips the mode once
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+    if (key == GLFW_KEY_P)
         usePerspective = !usePerspective;
+    if (key == GLFW_KEY_I)
+        useInstancing = !useInstancing;
+    if (key == GLFW_KEY_G)
+        useIndirect = !useIndirect;
+    if (key == GLFW_KEY_O)
+        useOcclusion = !useOcclusion;
+    if (key == GLFW_KEY_M)
+        useSoftwareOcclusion = !useSoftwareOcclusion;
+    if (key == GLFW_KEY_F)
+        pickRequested = true;
+    if (key == GLFW_KEY_T)
+        printStats = !printStats;
 }
 
 void loadTexture(std::string texturePath) {
@@ -173,6 +224,7 @@ int main () {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);  
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
 /*
 
     GLAD: Load all OpenGL Function Pointers
@@ -184,6 +236,11 @@ int main () {
         return -1;
     }    
 
+    // Persistent mapping for per-frame data; without it the ring buffers fall back to orphaning
+    if (!loadBufferStorage((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "GL_ARB_buffer_storage not available, dynamic buffers are orphaned each frame" << std::endl;
+    }
+
     // Random seed
     srand (time(NULL));
 
@@ -199,7 +256,7 @@ int main () {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glEnable(GL_DEPTH_TEST); 
+    GLState::shared().enable(GL_DEPTH_TEST);
 
     // Create the model matrix:
     glm::mat4 model = glm::mat4(1.0f);
@@ -232,8 +289,7 @@ int main () {
     glGenTextures(1, &greenglass);
     glGenTextures(1, &book);
    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, planks);
+    GLState::shared().bindTexture(0, GL_TEXTURE_2D, planks);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -241,8 +297,7 @@ int main () {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     loadTexture(".\\resources\\textures\\wood.jpg");
     
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, iron);
+    GLState::shared().bindTexture(1, GL_TEXTURE_2D, iron);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -252,8 +307,7 @@ int main () {
     loadTexture(".\\resources\\textures\\iron.jpg");
 
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, wax);
+    GLState::shared().bindTexture(2, GL_TEXTURE_2D, wax);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -262,8 +316,7 @@ int main () {
     // load and generate the texture
     loadTexture(".\\resources\\textures\\wax.jpg");
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, woodgrain);
+    GLState::shared().bindTexture(3, GL_TEXTURE_2D, woodgrain);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -272,8 +325,7 @@ int main () {
     // load and generate the texture
     loadTexture(".\\resources\\textures\\woodgrain.jpg");
 
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, bricks);
+    GLState::shared().bindTexture(4, GL_TEXTURE_2D, bricks);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -281,8 +333,7 @@ int main () {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     loadTexture(".\\resources\\textures\\wall.jpg");
 
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_2D, greenglass);
+    GLState::shared().bindTexture(5, GL_TEXTURE_2D, greenglass);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -290,8 +341,7 @@ int main () {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     loadTexture(".\\resources\\textures\\greenglass.jpg");
 
-    glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_2D, greenglass);
+    GLState::shared().bindTexture(6, GL_TEXTURE_2D, greenglass);
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -304,9 +354,21 @@ int main () {
     Shader myShader("../shaders/color.vs", "../shaders/color.fs");
     Shader lightSourceShader("../shaders/lightSource.vs", "../shaders/lightSource.fs");
     Shader lightingShader("../shaders/multiLight.vs", "../shaders/multiLight.fs");
+
+    // Camera and lights live in one uniform buffer that every program reads
+    FrameUniforms frameUniforms;
+    frameUniforms.init();
+    frameUniforms.attach(myShader);
+    frameUniforms.attach(lightSourceShader);
+    frameUniforms.attach(lightingShader);
     
     glm::vec3 lightPos = glm::vec3(3.0f, -3.0f, 1.0f);
 
+    // Pick the vertex format before the first mesh is uploaded
+    MeshCache::shared().pool.setFormat(useCompactVertices ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FLOAT);
+    lightingShader.use();
+    lightingShader.setBool("compactVertices", useCompactVertices);
+
     float helmetX, helmetY, helmetRadius;
     helmetX = -0.5f;
     helmetY = 0.0f;
@@ -331,7 +393,78 @@ int main () {
     Cone practiceCone(0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 112/255.f, 124/255.f, 130/255.f, 4);
     Cube lightSourceCube(lightPos.x, lightPos.y, lightPos.z, 0.5f, 0.5f, 0.5f,112/255.f, 124/255.f, 130/255.f);
     Cube subjectCube(0.0f, 0.0f, 0.0f, 2.0f, 2.0f, 2.0f, 112/255.f, 124/255.f, 130/255.f);
+
+    // The shapes above only asked for their meshes; load them from the disk cache, or generate them
+    // on all cores and save them for next time, and upload them here
+    MeshCache::shared().setDiskCache("meshes.cache");
+    MeshCache::shared().build();
     
+    // Set these for each material to alter the appearance
+    // Helmet
+    helmet_bottom.material.setTextures(1, 1, 100.0f);
+    helmet_top.material.setTextures(1, 1, 100.0f);
+
+    // Candle
+    candle_bottom.material.setTextures(3, 3, 20.0f);
+    candle_top.material.setTextures(2, 2, 20.0f);
+
+    // Bottle, in see-through green glass
+    bottle_bottom.material.setTextures(5, 5, 100.0f);
+    bottle_top.material.setTextures(5, 5, 100.0f);
+    bottle_bottom.material.setOpacity(0.6f);
+    bottle_top.material.setOpacity(0.6f);
+
+    // Book
+    book_model.material.setTextures(6, 6, 10.0f);
+
+    // Table
+    table.material.setTextures(0, 0, 10.0f);
+
+    std::vector<Shape*> sceneShapes = {&helmet_bottom, &helmet_top, &candle_bottom, &candle_top, &bottle_bottom, &bottle_top, &book_model, &table};
+
+    // Group the opaque scene objects by shared mesh for the instanced path;
+    // transparent ones always go through the render queue, which blends them back to front
+    InstancedRenderer instancedScene;
+    IndirectRenderer indirectScene;
+    std::vector<Shape*> transparentShapes;
+    for (Shape* shape : sceneShapes) {
+        if (!shape->material.transparent()) {
+            instancedScene.add(*shape);
+            indirectScene.add(*shape);
+        } else {
+            transparentShapes.push_back(shape);
+        }
+    }
+
+    // Sorts the per-object draws by state and depth each frame
+    RenderQueue renderQueue;
+    instancedScene.build(lightingShader, model);
+    if (IndirectRenderer::supported()) {
+        indirectScene.build();
+    } else {
+        std::cout << "GL 4.3 not available, opaque objects are culled and drawn from the CPU" << std::endl;
+    }
+
+    // Tests the shapes against the view frustum each frame. The scene is indexed once, and shapes marked
+    // dynamic are moved in the index each frame; the transparent shapes left over by the indirect path
+    // are few and tested one by one.
+    ShapeCuller sceneCuller;
+    ShapeCuller transparentCuller;
+    sceneCuller.index(sceneShapes, model);
+
+    // Tests the visible shapes against the depth buffer when useOcclusion is on
+    OcclusionCuller occlusionCuller;
+
+    // Tests the visible shapes against the software depth buffer when useSoftwareOcclusion is on
+    SoftwareOcclusion softwareOcclusion;
+
+    // LOD and culling counters summed over a second, then printed
+    LodStats lodTotals = {0, 0, 0};
+    CullStats cullTotals = {0, 0};
+    SoftwareOcclusionStats softwareTotals = {0, 0, 0, 0.0f};
+    int lodFrames = 0;
+    float lodTime = 0.0f;
+
     float candle_linear = 0.35f;
     float candle_quadratic = 0.44f;
     int linear_change_max = 15;
@@ -344,6 +477,7 @@ int main () {
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         processInput(window);
+        GLState::shared().beginFrame();
 
         glClearColor(0.0f, 0.0f, 0.0f, 10.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -357,81 +491,147 @@ int main () {
         
         // Enable lighting shader
         lightingShader.use();
-        
-        // Set the view position
-        lightingShader.setVec3("viewPos", cameraPos);
+
+        // Set the camera; each object supplies its own model
+        frameUniforms.camera.view = view;
+        frameUniforms.camera.projection = usePerspective ? perspective : ortho;
+        frameUniforms.camera.viewPos = cameraPos;
 
         // Set directional light properties
-        lightingShader.setVec3("dirLight.ambient", glm::vec3(0.1f, 0.0f, 0.5f)); 
-        lightingShader.setVec3("dirLight.diffuse", glm::vec3(0.1f, 0.0f, 0.5f));  // Create a blue effect
-        lightingShader.setVec3("dirLight.specular", glm::vec3(0.1f, 0.0f, 0.5f));
-        lightingShader.setVec3("dirLight.direction", glm::vec3(3.0f, 0.0f, -3.0f)); // Put the light on the left side
+        DirLightData &dirLight = frameUniforms.lights.dirLight;
+        dirLight.ambient = glm::vec3(0.1f, 0.0f, 0.5f);
+        dirLight.diffuse = glm::vec3(0.1f, 0.0f, 0.5f);  // Create a blue effect
+        dirLight.specular = glm::vec3(0.1f, 0.0f, 0.5f);
+        dirLight.direction = glm::vec3(3.0f, 0.0f, -3.0f); // Put the light on the left side
 
         // Set point light properties
-        lightingShader.setVec3("pointLights[0].position", glm::vec3(candleX, candleY, 0.75f)); // Place the light on the candle
-        lightingShader.setVec3("pointLights[0].ambient", glm::vec3(251/255.f, 236/255.f, 93/255.f));
-        lightingShader.setVec3("pointLights[0].diffuse", glm::vec3(251/255.f, 236/255.f, 93/255.f));  // Set the color to a warm yellow  rgb(251, 236, 93)
-        lightingShader.setVec3("pointLights[0].specular", glm::vec3(251/255.f, 236/255.f, 93/255.f));
-        lightingShader.setFloat("pointLights[0].constant", 1.0f );
-        lightingShader.setFloat("pointLights[0].linear", 0.35f + flicker_linear_add);
-        lightingShader.setFloat("pointLights[0].quadratic", 0.44f + flicker_quadratic_add);
-
-
-        // Set model, view, and projection for lighting shader
-        lightingShader.setMatrix4fv("model", model);
-        lightingShader.setMatrix4fv("view", view);
-        if (usePerspective) {
-            lightingShader.setMatrix4fv("projection", perspective);
-        } else {
-            lightingShader.setMatrix4fv("projection", ortho);
+        PointLightData &candleLight = frameUniforms.lights.pointLights[0];
+        candleLight.position = glm::vec3(candleX, candleY, 0.75f); // Place the light on the candle
+        candleLight.ambient = glm::vec3(251/255.f, 236/255.f, 93/255.f);
+        candleLight.diffuse = glm::vec3(251/255.f, 236/255.f, 93/255.f);  // Set the color to a warm yellow  rgb(251, 236, 93)
+        candleLight.specular = glm::vec3(251/255.f, 236/255.f, 93/255.f);
+        candleLight.constant = 1.0f;
+        candleLight.linear = 0.35f + flicker_linear_add;
+        candleLight.quadratic = 0.44f + flicker_quadratic_add;
+
+        // One buffer write serves every program this frame
+        frameUniforms.update();
+
+        // Only uploads when a material was added since the last frame
+        MaterialLibrary::shared().upload(lightingShader);
+
+        // Only shapes inside the view volume are submitted. The indirect path culls the opaque
+        // shapes on the GPU, which leaves the CPU only the transparent ones.
+        bool drawIndirect = useIndirect && !useOcclusion && IndirectRenderer::supported();
+        bool drawInstanced = useInstancing && !useOcclusion;
+        std::vector<Shape*> &cpuShapes = drawIndirect ? transparentShapes : sceneShapes;
+        ShapeCuller &culler = drawIndirect ? transparentCuller : sceneCuller;
+        glm::mat4 projection = usePerspective ? perspective : ortho;
+        sceneCuller.update(model);
+        CullStats cullStats = culler.cull(cpuShapes, model, projection * view);
+        if (useSoftwareOcclusion) {
+            SoftwareOcclusionStats softwareStats = softwareOcclusion.cull(cpuShapes, culler.bounds, model, projection * view);
+            softwareTotals.rejected += softwareStats.rejected;
+            softwareTotals.tested += softwareStats.tested;
+            softwareTotals.milliseconds += softwareStats.milliseconds;
+        }
+
+        // Cast a ray from the camera through the centre of the screen into the indexed scene
+        if (pickRequested) {
+            float distance = 0.0f;
+            Shape* picked = sceneCuller.pick(cameraPos, cameraFront, 100.0f, distance);
+            if (picked != nullptr) {
+                int index = std::find(sceneShapes.begin(), sceneShapes.end(), picked) - sceneShapes.begin();
+                std::cout << "Picked: scene shape " << index << " at distance " << distance << std::endl;
+            } else {
+                std::cout << "Picked: nothing" << std::endl;
+            }
+            pickRequested = false;
+        }
+
+        // Pick each visible shape's level of detail for the current camera and projection;
+        // shapes culled on the GPU are not known to be visible yet, so they all pick one
+        LodStats lodStats = {0, 0, 0};
+        for (Shape* shape : sceneShapes) {
+            if (shape->visible || (drawIndirect && !shape->material.transparent())) {
+                shape->selectLod(model, view, projection, viewportHeight, lodStats);
+            }
+        }
+
+        // Queue the visible shapes not drawn instanced, keyed by state and by distance from the camera
+        renderQueue.clear();
+        renderQueue.setOcclusion(useOcclusion ? &occlusionCuller : nullptr);
+        if (useOcclusion) {
+            occlusionCuller.beginFrame();
         }
+        for (unsigned int i = 0; i < cpuShapes.size(); i++) {
+            Shape* shape = cpuShapes[i];
+            if (shape->visible && ((!drawInstanced && !drawIndirect) || shape->material.transparent())) {
+                float depth = -(view * glm::vec4(culler.bounds.get(i).center, 1.0f)).z;
+                renderQueue.push(lightingShader, *shape, model * shape->model, depth);
+            }
+        }
+        renderQueue.sort();
+
+        if (drawIndirect) {
+            indirectScene.update(model, projection * view);
+            indirectScene.draw(lightingShader);
+        } else if (drawInstanced) {
+            instancedScene.update(model);
+            instancedScene.draw(lightingShader);
+        }
+        renderQueue.draw();
 
-        // Set these for each material to alter the appearance
-        // Helmet
-        // Set material properties
-        lightingShader.setInt("material.specular", 1);
-        lightingShader.setInt("material.diffuse", 1);
-        lightingShader.setFloat("material.shininess", 100.0f);
-        helmet_bottom.draw();
-        helmet_top.draw();
-
-        // Candle
-        // Set material properties
-        lightingShader.setInt("material.specular", 3);
-        lightingShader.setInt("material.diffuse", 3);
-        lightingShader.setFloat("material.shininess", 20.0f);
-        candle_bottom.draw();
-
-        lightingShader.setInt("material.specular", 2);
-        lightingShader.setInt("material.diffuse", 2);
-        candle_top.draw();
-
-        // Bottle
-        // Set material properties
-        lightingShader.setInt("material.specular", 5);
-        lightingShader.setInt("material.diffuse", 5);
-        lightingShader.setFloat("material.shininess", 100.0f);
-        bottle_bottom.draw();
-        bottle_top.draw();
-
-        // Book
-        // Set material properties
-        lightingShader.setInt("material.specular", 6);
-        lightingShader.setInt("material.diffuse", 6);
-        lightingShader.setFloat("material.shininess", 10.0f);
-        book_model.draw();
-
-        // Table
-        // Set material properties
-        lightingShader.setInt("material.specular", 0);
-        lightingShader.setInt("material.diffuse", 0);
-        lightingShader.setFloat("material.shininess", 10.0f);
-        table.draw();
+        // Query the boxes against this frame's depth; the next frame's draws are conditional on the results
+        if (useOcclusion) {
+            occlusionCuller.queryBounds(lightSourceShader, cpuShapes, culler.bounds, cameraPos);
+        }
+
+        lodTotals.trianglesDrawn += lodStats.trianglesDrawn;
+        lodTotals.trianglesSaved += lodStats.trianglesSaved;
+        lodTotals.levelChanges += lodStats.levelChanges;
+        cullTotals.visible += cullStats.visible;
+        cullTotals.total += cullStats.total;
+        lodFrames++;
+        lodTime += deltaTime;
+        if (lodTime >= 1.0f) {
+            // The counters are reset every second whether or not they are printed
+            if (printStats) {
+                std::cout << "LOD: " << 1000.0f * lodTime / lodFrames << " ms/frame, " << lodTotals.trianglesDrawn / lodFrames << " triangles drawn, "
+                          << lodTotals.trianglesSaved / lodFrames << " saved, " << lodTotals.levelChanges << " level changes" << std::endl;
+                std::cout << "Culling: " << cullTotals.visible / lodFrames << " of " << cullTotals.total / lodFrames << " objects visible" << (drawIndirect ? " on the CPU, opaque objects culled on the GPU" : "") << std::endl;
+                std::cout << "GL state: " << GLState::shared().lastFrame.issued << " calls issued, " << GLState::shared().lastFrame.filtered << " filtered" << std::endl;
+                std::cout << "Queue: " << renderQueue.stats.draws << " draws, " << renderQueue.stats.programChanges << " program, "
+                          << renderQueue.stats.materialChanges << " material and " << renderQueue.stats.vertexArrayChanges << " vertex array changes" << std::endl;
+                if (useSoftwareOcclusion) {
+                    std::cout << "Software occlusion: " << softwareTotals.rejected / lodFrames << " of " << softwareTotals.tested / lodFrames << " objects rejected, "
+                              << softwareTotals.milliseconds / lodFrames << " ms/frame" << std::endl;
+                }
+                if (useOcclusion) {
+                    OcclusionStats &occlusionStats = occlusionCuller.lastFrame;
+                    std::cout << "Occlusion: " << occlusionStats.culled << " objects culled, " << occlusionStats.queried << " queries issued, " << occlusionStats.pending << " pending, "
+                              << (occlusionStats.resolved > 0 ? (float)occlusionStats.latency / occlusionStats.resolved : 0.0f) << " frames latency" << std::endl;
+                }
+                // Counted over the whole second, for the lit program that takes nearly every set
+                UniformCounters uniformCounters = lightingShader.counters();
+                std::cout << "Instance ring: " << (instancedScene.ring.persistent ? "persistent" : "orphaned") << ", " << instancedScene.ring.stalls << " stalls" << std::endl;
+                std::cout << "Uniforms: " << uniformCounters.misses << " uploaded, " << uniformCounters.hits << " skipped as unchanged" << std::endl;
+            }
+            lightingShader.resetCounters();
+            lodTotals = {0, 0, 0};
+            cullTotals = {0, 0};
+            softwareTotals = {0, 0, 0, 0.0f};
+            lodFrames = 0;
+            lodTime = 0.0f;
+        }
 
         glfwPollEvents();    
         glfwSwapBuffers(window);
     }
 
+    // Free the renderers' GL objects while the context still exists
+    instancedScene.release();
+    indirectScene.release();
     glfwTerminate();
     return 0;
 
@@ -0,0 +1,231 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "mesh.h"
+#include "shapes.h"
+#include "occlusion.h"
+
+// Draws are sorted by a 64-bit key, most significant field first.
+//   opaque:      pass 2 | shader 6 | material 8 | mesh 16 | depth 24 | unused 8
+//   transparent: pass 2 | far-to-near depth 24 | shader 6 | material 8 | mesh 16 | unused 8
+// Opaque draws group by state and go front to back within it, so early depth testing rejects
+// what is hidden; transparent ones must blend back to front, so depth comes before state.
+enum RenderPass {
+    RENDER_PASS_OPAQUE,
+    RENDER_PASS_TRANSPARENT
+};
+
+const int RENDER_KEY_SHADER_BITS = 6;
+const int RENDER_KEY_MATERIAL_BITS = 8;
+const int RENDER_KEY_MESH_BITS = 16;
+const int RENDER_KEY_DEPTH_BITS = 24;
+
+// One queued draw: the key to sort on and which item it draws
+struct RenderCommand
+{
+    uint64_t key;
+    int item;
+};
+
+// What a draw needs once its turn comes
+struct RenderItem
+{
+    Shader* shader;
+    Mesh* mesh;
+    glm::mat4 model;
+    int materialIndex;
+    RenderPass pass;
+    int occlusion; // the shape's OcclusionCuller object, or -1 when occlusion culling is off
+};
+
+// State changes made by the last draw(), to compare sort orders
+struct RenderQueueStats
+{
+    int draws;
+    int programChanges;
+    int materialChanges;
+    int vertexArrayChanges;
+};
+
+// Keep the top bits of a non-negative float; the bit patterns of such floats sort like their values
+uint32_t quantizeDepth(float depth) {
+    if (!(depth > 0.0f)) {
+        return 0;
+    }
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits >> (32 - 1 - RENDER_KEY_DEPTH_BITS);
+}
+
+// Sort commands by key: least significant byte first, counting sort per byte.
+// Bytes that are equal in every key, such as unused fields, are skipped.
+void radixSort(std::vector<RenderCommand> &commands, std::vector<RenderCommand> &scratch) {
+    scratch.resize(commands.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        int counts[256] = {0};
+        for (const RenderCommand &command : commands) {
+            counts[(command.key >> shift) & 0xFF]++;
+        }
+        if (counts[(commands.empty() ? 0 : commands[0].key >> shift) & 0xFF] == (int)commands.size()) {
+            continue;
+        }
+        int offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            int count = counts[digit];
+            counts[digit] = offset;
+            offset += count;
+        }
+        for (const RenderCommand &command : commands) {
+            scratch[counts[(command.key >> shift) & 0xFF]++] = command;
+        }
+        commands.swap(scratch);
+    }
+}
+
+class RenderQueue
+{
+    public:
+
+        // Forget last frame's draws
+        void clear();
+
+        // Queue a shape at its current level of detail. depth is its distance in front of the camera.
+        void push(Shader &shader, Shape &shape, const glm::mat4 &model, float depth);
+
+        // Sort the queued draws by key
+        void sort();
+
+        // Draw everything in key order, changing program, material and vertex array only when they differ
+        void draw();
+
+        // Skip draws whose bounding box was hidden last frame; nullptr turns it off
+        void setOcclusion(OcclusionCuller* culler);
+
+        RenderQueueStats stats;
+
+    private:
+        OcclusionCuller* occlusion = nullptr;
+
+        std::vector<RenderCommand> commands;
+        std::vector<RenderCommand> scratch;
+        std::vector<RenderItem> items;
+
+        // Shaders seen so far; a shader's key field is its position here
+        std::vector<Shader*> shaders;
+
+        int shaderKey(Shader* shader);
+};
+
+void RenderQueue::clear() {
+    commands.clear();
+    items.clear();
+}
+
+int RenderQueue::shaderKey(Shader* shader) {
+    for (unsigned int i = 0; i < shaders.size(); i++) {
+        if (shaders[i] == shader) {
+            return i;
+        }
+    }
+    shaders.push_back(shader);
+    return shaders.size() - 1;
+}
+
+void RenderQueue::push(Shader &shader, Shape &shape, const glm::mat4 &model, float depth) {
+    RenderItem item;
+    item.shader = &shader;
+    item.mesh = shape.mesh;
+    item.model = model;
+    item.materialIndex = shape.getMaterialIndex();
+    item.pass = shape.material.transparent() ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+    item.occlusion = occlusion != nullptr ? occlusion->object(&shape) : -1;
+
+    uint64_t shaderField = shaderKey(&shader) & ((1 << RENDER_KEY_SHADER_BITS) - 1);
+    uint64_t materialField = item.materialIndex & ((1 << RENDER_KEY_MATERIAL_BITS) - 1);
+    uint64_t meshField = item.mesh->id & ((1 << RENDER_KEY_MESH_BITS) - 1);
+    uint64_t depthField = quantizeDepth(depth);
+    uint64_t state = (shaderField << (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_MESH_BITS)) | (materialField << RENDER_KEY_MESH_BITS) | meshField;
+    const int stateBits = RENDER_KEY_SHADER_BITS + RENDER_KEY_MATERIAL_BITS + RENDER_KEY_MESH_BITS;
+
+    RenderCommand command;
+    if (item.pass == RENDER_PASS_OPAQUE) {
+        command.key = ((uint64_t)RENDER_PASS_OPAQUE << 62) | (state << (RENDER_KEY_DEPTH_BITS + 8)) | (depthField << 8);
+    } else {
+        uint64_t farFirst = ((1 << RENDER_KEY_DEPTH_BITS) - 1) - depthField;
+        command.key = ((uint64_t)RENDER_PASS_TRANSPARENT << 62) | (farFirst << (stateBits + 8)) | (state << 8);
+    }
+    command.item = items.size();
+    items.push_back(item);
+    commands.push_back(command);
+}
+
+void RenderQueue::setOcclusion(OcclusionCuller* culler) {
+    occlusion = culler;
+}
+
+void RenderQueue::sort() {
+    radixSort(commands, scratch);
+}
+
+void RenderQueue::draw() {
+    stats = {0, 0, 0, 0};
+    Shader* shader = nullptr;
+    Uniform<glm::mat4> modelUniform;
+    Uniform<int> materialUniform;
+    int materialIndex = -1;
+    unsigned int vertexArray = 0;
+    bool blending = false;
+
+    for (const RenderCommand &command : commands) {
+        const RenderItem &item = items[command.item];
+        if (item.pass == RENDER_PASS_TRANSPARENT && !blending) {
+            // See-through objects blend over the finished opaque scene and do not hide each other
+            GLState::shared().enable(GL_BLEND);
+            GLState::shared().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            GLState::shared().depthMask(false);
+            blending = true;
+        }
+        if (item.shader != shader) {
+            shader = item.shader;
+            shader->use();
+            modelUniform = shader->uniform<glm::mat4>(UNIFORM_MODEL);
+            materialUniform = shader->uniform<int>(UNIFORM_MATERIAL_INDEX);
+            materialIndex = -1;
+            stats.programChanges++;
+        }
+        if (item.materialIndex != materialIndex) {
+            materialIndex = item.materialIndex;
+            shader->set(materialUniform, materialIndex);
+            stats.materialChanges++;
+        }
+        if (item.mesh->VAOc != vertexArray) {
+            vertexArray = item.mesh->VAOc;
+            GLState::shared().bindVertexArray(vertexArray);
+            stats.vertexArrayChanges++;
+        }
+        shader->set(modelUniform, item.model);
+        if (item.occlusion >= 0) {
+            occlusion->beginDraw(item.occlusion);
+            item.mesh->drawElements();
+            occlusion->endDraw(item.occlusion);
+        } else {
+            item.mesh->drawElements();
+        }
+        stats.draws++;
+    }
+
+    if (blending) {
+        GLState::shared().depthMask(true);
+        GLState::shared().disable(GL_BLEND);
+    }
+}
+#endif
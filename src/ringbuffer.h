@@ -0,0 +1,209 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Frames the GPU may still be reading while the CPU writes the next one
+const int RING_BUFFER_FRAMES = 3;
+
+// Space handed out for this frame: write to data, then point GL at offset in the ring's buffer
+struct RingAllocation
+{
+    unsigned char* data;
+    size_t offset;
+};
+
+// Load glBufferStorage through GL_ARB_buffer_storage when the context is older than 4.4.
+// gladLoadGLLoader only loads core functions of the version the context reports.
+bool loadBufferStorage(GLADloadproc load) {
+    if (glBufferStorage != NULL) {
+        return true;
+    }
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != NULL && strcmp(extension, "GL_ARB_buffer_storage") == 0) {
+            glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+            return glBufferStorage != NULL;
+        }
+    }
+    return false;
+}
+
+// Per-frame dynamic data such as instance matrices. With buffer storage the buffer holds
+// RING_BUFFER_FRAMES regions, mapped once and kept mapped; each frame writes the next region,
+// after waiting on the fence of the frame that last used it. Without buffer storage there is
+// one region kept in CPU memory, and commit() orphans the buffer before uploading it, so the
+// driver hands out fresh storage instead of waiting for draws still reading the old one.
+//
+// Each frame: beginFrame(), allocate() as needed, commit(), draw, then endFrame().
+class RingBuffer
+{
+    public:
+
+        RingBuffer();
+
+        // Create the buffer with room for frameBytes per frame. Each region starts on a multiple of
+        // alignment, the largest alignment allocate() will be asked for.
+        void init(size_t frameBytes, size_t alignment = 16);
+
+        // Move to the next region, waiting for the GPU only if it still reads it
+        void beginFrame();
+
+        // Take bytes of this frame's region, at an offset in the buffer that is a multiple of alignment;
+        // data is NULL when the region is full or alignment does not divide the one given to init()
+        RingAllocation allocate(size_t bytes, size_t alignment = 16);
+
+        // Make this frame's writes visible to GL; call once, after the last allocate() of the frame
+        void commit();
+
+        // Fence the draws that read this frame's region
+        void endFrame();
+
+        // Delete the buffer and fences. Needs the context current, so call it before the context is
+        // destroyed; objects still alive then go with the context.
+        void release();
+
+        // True when the buffer stays mapped, false when it falls back to orphaning
+        bool persistent;
+
+        // Frames where beginFrame() had to wait for the GPU
+        int stalls;
+
+        unsigned int buffer;
+
+    private:
+        size_t frameBytes;
+        size_t frameAlignment;
+        size_t cursor;
+        int region;
+        unsigned char* mapped;
+        GLsync fences[RING_BUFFER_FRAMES];
+        std::vector<unsigned char> staging;
+};
+
+RingBuffer::RingBuffer() {
+    persistent = false;
+    stalls = 0;
+    buffer = 0;
+    frameBytes = cursor = 0;
+    frameAlignment = 16;
+    region = 0;
+    mapped = NULL;
+    for (GLsync &fence : fences) {
+        fence = 0;
+    }
+}
+
+void RingBuffer::init(size_t bytes, size_t alignment) {
+    // Whole multiples of the alignment keep every region's start aligned
+    frameAlignment = alignment > 0 ? alignment : 16;
+    frameBytes = (std::max(bytes, (size_t)1) + frameAlignment - 1) / frameAlignment * frameAlignment;
+    // Initialising again replaces the buffer
+    release();
+    glGenBuffers(1, &buffer);
+    // The copy target leaves the array and element bindings of the current VAO alone
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    persistent = glBufferStorage != NULL;
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, RING_BUFFER_FRAMES * frameBytes, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, RING_BUFFER_FRAMES * frameBytes, flags);
+        if (mapped == NULL) {
+            std::cout << "ERROR::RING_BUFFER::MAP_FAILED falling back to orphaning" << std::endl;
+            // Storage made with glBufferStorage is immutable, so start over with a plain buffer
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            persistent = false;
+        }
+    }
+    if (!persistent) {
+        staging.resize(frameBytes);
+        glBufferData(GL_COPY_WRITE_BUFFER, frameBytes, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    region = RING_BUFFER_FRAMES - 1;
+}
+
+void RingBuffer::beginFrame() {
+    cursor = 0;
+    if (!persistent) {
+        return;
+    }
+    region = (region + 1) % RING_BUFFER_FRAMES;
+    GLsync &fence = fences[region];
+    if (fence) {
+        // Already signalled in the normal case; a wait here means the CPU is RING_BUFFER_FRAMES ahead
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            stalls++;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+}
+
+RingAllocation RingBuffer::allocate(size_t bytes, size_t alignment) {
+    if (alignment == 0 || frameAlignment % alignment != 0) {
+        std::cout << "ERROR::RING_BUFFER::ALIGNMENT " << alignment << " does not divide " << frameAlignment << std::endl;
+        return RingAllocation{NULL, 0};
+    }
+    size_t start = (cursor + alignment - 1) / alignment * alignment;
+    if (start + bytes > frameBytes) {
+        std::cout << "ERROR::RING_BUFFER::FULL " << bytes << " bytes asked, " << frameBytes - cursor << " left" << std::endl;
+        return RingAllocation{NULL, 0};
+    }
+    cursor = start + bytes;
+    if (persistent) {
+        size_t offset = region * frameBytes + start;
+        return RingAllocation{mapped + offset, offset};
+    }
+    return RingAllocation{staging.data() + start, start};
+}
+
+void RingBuffer::commit() {
+    // A coherent mapping is already visible; the fallback orphans and uploads what was written
+    if (persistent || cursor == 0) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, frameBytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, cursor, staging.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void RingBuffer::release() {
+    for (GLsync &fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+    // Deleting the buffer also unmaps it
+    if (buffer != 0) {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    mapped = NULL;
+    persistent = false;
+    staging.clear();
+}
+
+void RingBuffer::endFrame() {
+    if (persistent) {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+#endif
@@ -4,15 +4,71 @@
 
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
 
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <map>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "glstate.h"
+
+// FNV-1a hash of a uniform name; constexpr so names known at compile time cost nothing to hash
+constexpr uint32_t hashUniformName(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+// A uniform name and its hash. Declare hot names constexpr so the hash is computed by the compiler;
+// names built at run time are hashed when converted. The name is only borrowed, for the lookup
+// to tell apart names whose hashes collide.
+struct UniformName
+{
+    uint32_t hash;
+    const char* name;
+
+    constexpr UniformName(const char* name) : hash(hashUniformName(name)), name(name) {}
+    UniformName(const std::string &name) : hash(hashUniformName(name.c_str())), name(name.c_str()) {}
+};
+
+// A uniform resolved once with Shader::uniform<T>(); setting through it skips the name lookup
+template <typename T>
+struct Uniform
+{
+    int location = -1;
+    int shadow = -1;    // where the program's last value is kept, or -1 if it is not tracked
+};
+
+// Uniform sets that matched the value the program already had and were skipped (hits),
+// and sets that had to be uploaded (misses)
+struct UniformCounters
+{
+    int hits;
+    int misses;
+};
+
+// Floats needed to keep a copy of a uniform of this GL type
+int uniformComponents(GLenum type) {
+    switch (type) {
+        case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_BOOL_VEC2: return 2;
+        case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_BOOL_VEC3: return 3;
+        case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2: return 4;
+        case GL_FLOAT_MAT3: return 9;
+        case GL_FLOAT_MAT4: return 16;
+        default: return 1;  // scalars and samplers
+    }
+}
+
 class Shader
 {
 public:
@@ -21,86 +77,126 @@ public:
   
     // constructor reads and builds the shader
     Shader(const char* vertexPath, const char* fragmentPath);
+    // constructor for a compute program, which needs GL 4.3
+    Shader(const char* computePath);
     // use/activate the shader
     void use();
-    // utility uniform functions
-    void setBool(const std::string &name, bool value) const;  
-    void setInt(const std::string &name, int value) const;   
-    void setFloat(const std::string &name, float value) const;
-    void setMatrix4fv(const std::string &name, glm::mat4 value) const;
-    void setVec3(const std::string &name, glm::vec3 value) const;
+    // utility uniform functions; names the program does not use are ignored
+    void setBool(UniformName name, bool value) const;  
+    void setInt(UniformName name, int value) const;   
+    void setFloat(UniformName name, float value) const;
+    void setMatrix4fv(UniformName name, const glm::mat4 &value) const;
+    void setVec3(UniformName name, glm::vec3 value) const;
 
+    // Resolve a uniform to a handle; the handle of a missing uniform does nothing when set
+    template <typename T>
+    Uniform<T> uniform(UniformName name) const;
 
-};
+    void set(Uniform<bool> uniform, bool value) const;
+    void set(Uniform<int> uniform, int value) const;
+    void set(Uniform<float> uniform, float value) const;
+    void set(Uniform<glm::vec3> uniform, glm::vec3 value) const;
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const;
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+    // Location of a uniform, or -1 if the program has none by that name
+    int location(UniformName name) const;
 
-    // ensure ifstream objects can throw exceptions
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    // Skipped and uploaded sets since the last resetCounters()
+    UniformCounters counters() const;
+    void resetCounters();
 
-    try {
-        // Open shader files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
+private:
+    // Open addressing table of every active uniform, keyed by name hash; its size is a power of two
+    struct UniformSlot
+    {
+        uint32_t hash;
+        int location;   // -1 marks an empty slot
+        int shadow;     // offset of the uniform's copy in shadowValues
+        int components; // floats in that copy
+        int name;       // index in uniformNames, compared once the hash matches
+    };
+    std::vector<UniformSlot> uniforms;
+    std::vector<std::string> uniformNames;
 
-        // Read files buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+    // The last value uploaded to each uniform of this program, so a set that changes nothing is skipped.
+    // Uniform values belong to the program, so the copies stay right across use() of other programs.
+    mutable std::vector<float> shadowValues;
+    mutable std::vector<unsigned char> shadowKnown;   // per offset; only the first of each copy is used
+    mutable UniformCounters uniformCounters;
 
-        vShaderFile.close();
-        fShaderFile.close();
+    // Read a shader source file, reporting a failure and returning an empty string
+    static std::string readFile(const char* path);
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+    // Compile one stage from its source file; stageName labels its errors
+    static unsigned int compileStage(GLenum type, const char* path, const char* stageName);
 
-    } catch(std::ifstream::failure e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-    }
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+    // Link the compiled stages into ID, delete them and reflect the program's uniforms
+    void linkProgram(std::initializer_list<unsigned int> stages);
 
-    // ### Compile shaders ###
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
+    // Fill the table from the linked program's active uniforms
+    void reflectUniforms();
+    void addUniform(const std::string &name, int location, int shadow, int components);
 
-    // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
+    // Compare a value with the shadow copy and update it; returns true if the value must be uploaded
+    bool changed(int shadow, const void* value, int bytes) const;
+};
 
-    // check for errors
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    };
+Shader::Shader(const char* vertexPath, const char* fragmentPath) {
+    unsigned int vertex = compileStage(GL_VERTEX_SHADER, vertexPath, "VERTEX");
+    unsigned int fragment = compileStage(GL_FRAGMENT_SHADER, fragmentPath, "FRAGMENT");
+    linkProgram({vertex, fragment});
+}
+
+Shader::Shader(const char* computePath) {
+    unsigned int compute = compileStage(GL_COMPUTE_SHADER, computePath, "COMPUTE");
+    linkProgram({compute});
+}
 
-    // fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
+std::string Shader::readFile(const char* path) {
+    std::ifstream file;
+    // ensure ifstream objects can throw exceptions
+    file.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    try {
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        file.close();
+        return stream.str();
+    } catch(const std::ifstream::failure &e) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+    }
+    return std::string();
+}
 
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+unsigned int Shader::compileStage(GLenum type, const char* path, const char* stageName) {
+    std::string code = readFile(path);
+    const char* source = code.c_str();
+    unsigned int stage = glCreateShader(type);
+    glShaderSource(stage, 1, &source, NULL);
+    glCompileShader(stage);
 
+    // check for errors
+    int success;
+    char infoLog[512];
+    glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
     if (!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glGetShaderInfoLog(stage, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << stageName << "::COMPILATION_FAILED\n" << infoLog << std::endl;
     }
+    return stage;
+}
 
+void Shader::linkProgram(std::initializer_list<unsigned int> stages) {
     // Create shader program
     ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
+    for (unsigned int stage : stages) {
+        glAttachShader(ID, stage);
+    }
     glLinkProgram(ID);
 
     // Check for errors
+    int success;
+    char infoLog[512];
     glGetProgramiv(ID, GL_LINK_STATUS, &success);
     if (!success) {
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
@@ -109,32 +205,193 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
 
     // Delete the unused shaders as they're already linked and no
     // longer needed
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    for (unsigned int stage : stages) {
+        glDeleteShader(stage);
+    }
+
+    reflectUniforms();
+}
+
+void Shader::reflectUniforms() {
+    int count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    // Arrays of plain types report one entry for the whole array, so count their elements too
+    std::vector<std::string> names;
+    std::vector<int> components;
+    std::vector<char> buffer(maxLength + 1);
+    for (int i = 0; i < count; i++) {
+        int size = 0;
+        GLenum type;
+        glGetActiveUniform(ID, i, buffer.size(), NULL, &size, &type, buffer.data());
+        std::string name = buffer.data();
+        if (name.compare(0, 3, "gl_") == 0) {
+            continue;
+        }
+        int floats = uniformComponents(type);
+        if (size > 1 && name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            std::string base = name.substr(0, name.size() - 3);
+            names.push_back(base);
+            components.push_back(floats);
+            for (int element = 0; element < size; element++) {
+                names.push_back(base + "[" + std::to_string(element) + "]");
+                components.push_back(floats);
+            }
+        } else {
+            names.push_back(name);
+            components.push_back(floats);
+            // GL names a single element array "name[0]"; it can be set as "name" too
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                names.push_back(name.substr(0, name.size() - 3));
+                components.push_back(floats);
+            }
+        }
+    }
+
+    // Keep the table at most half full so probes stay short
+    int capacity = 16;
+    while (capacity < 2 * (int)names.size()) {
+        capacity *= 2;
+    }
+    uniforms.assign(capacity, UniformSlot{0, -1, -1, 0, -1});
+    uniformNames.clear();
+
+    // Names for the same location, such as "name" and "name[0]", share one shadow copy
+    std::map<int, int> shadowOfLocation;
+    shadowValues.clear();
+    for (unsigned int i = 0; i < names.size(); i++) {
+        int uniformLocation = glGetUniformLocation(ID, names[i].c_str());
+        if (uniformLocation < 0) {
+            continue;
+        }
+        std::map<int, int>::iterator found = shadowOfLocation.find(uniformLocation);
+        if (found == shadowOfLocation.end()) {
+            found = shadowOfLocation.insert(std::make_pair(uniformLocation, (int)shadowValues.size())).first;
+            shadowValues.resize(shadowValues.size() + components[i]);
+        }
+        addUniform(names[i], uniformLocation, found->second, components[i]);
+    }
+    shadowKnown.assign(shadowValues.size(), 0);
+    uniformCounters = {0, 0};
+}
+
+void Shader::addUniform(const std::string &name, int uniformLocation, int shadow, int components) {
+    uint32_t hash = hashUniformName(name.c_str());
+    unsigned int mask = uniforms.size() - 1;
+    for (unsigned int slot = hash & mask; ; slot = (slot + 1) & mask) {
+        if (uniforms[slot].location < 0) {
+            uniforms[slot] = UniformSlot{hash, uniformLocation, shadow, components, (int)uniformNames.size()};
+            uniformNames.push_back(name);
+            return;
+        }
+        // Names whose hashes collide each get a slot further along the probe
+        if (uniforms[slot].hash == hash && uniformNames[uniforms[slot].name] == name) {
+            return;
+        }
+    }
+}
 
+int Shader::location(UniformName name) const {
+    return uniform<float>(name).location;
+}
+
+template <typename T>
+Uniform<T> Shader::uniform(UniformName name) const {
+    Uniform<T> handle;
+    if (uniforms.empty()) {
+        return handle;
+    }
+    unsigned int mask = uniforms.size() - 1;
+    for (unsigned int slot = name.hash & mask; uniforms[slot].location >= 0; slot = (slot + 1) & mask) {
+        if (uniforms[slot].hash == name.hash && uniformNames[uniforms[slot].name] == name.name) {
+            handle.location = uniforms[slot].location;
+            // A value too large for the copy, such as a mat4 set on a float, is uploaded untracked
+            if ((int)sizeof(T) <= uniforms[slot].components * (int)sizeof(float)) {
+                handle.shadow = uniforms[slot].shadow;
+            }
+            break;
+        }
+    }
+    return handle;
+}
+
+bool Shader::changed(int shadow, const void* value, int bytes) const {
+    if (shadow < 0) {
+        return true;
+    }
+    float* copy = &shadowValues[shadow];
+    if (shadowKnown[shadow] && memcmp(copy, value, bytes) == 0) {
+        uniformCounters.hits++;
+        return false;
+    }
+    memcpy(copy, value, bytes);
+    shadowKnown[shadow] = 1;
+    uniformCounters.misses++;
+    return true;
+}
+
+UniformCounters Shader::counters() const {
+    return uniformCounters;
+}
+
+void Shader::resetCounters() {
+    uniformCounters = {0, 0};
 }
 
 void Shader::use() {
-    glUseProgram(ID);
+    GLState::shared().useProgram(ID);
 }
 
-void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+void Shader::setBool(UniformName name, bool value) const {
+    set(uniform<bool>(name), value);
 }
 
-void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setInt(UniformName name, int value) const {
+    set(uniform<int>(name), value);
 }
 
-void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setFloat(UniformName name, float value) const {
+    set(uniform<float>(name), value);
 }
 
-void Shader::setMatrix4fv(const std::string &name, glm::mat4 value) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+void Shader::setMatrix4fv(UniformName name, const glm::mat4 &value) const {
+    set(uniform<glm::mat4>(name), value);
+}
+
+void Shader::setVec3(UniformName name, glm::vec3 value) const {
+    set(uniform<glm::vec3>(name), value);
+}
+
+void Shader::set(Uniform<bool> uniform, bool value) const {
+    // Stored as the int GL keeps, so true set through setInt(1) and setBool match
+    int stored = value ? 1 : 0;
+    if (uniform.location >= 0 && changed(uniform.shadow, &stored, sizeof(stored))) {
+        glUniform1i(uniform.location, stored);
+    }
 }
 
-void Shader::setVec3(const std::string &name, glm::vec3 value) const {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z); 
+void Shader::set(Uniform<int> uniform, int value) const {
+    if (uniform.location >= 0 && changed(uniform.shadow, &value, sizeof(value))) {
+        glUniform1i(uniform.location, value);
+    }
+}
+
+void Shader::set(Uniform<float> uniform, float value) const {
+    if (uniform.location >= 0 && changed(uniform.shadow, &value, sizeof(value))) {
+        glUniform1f(uniform.location, value);
+    }
+}
+
+void Shader::set(Uniform<glm::vec3> uniform, glm::vec3 value) const {
+    if (uniform.location >= 0 && changed(uniform.shadow, &value, sizeof(value))) {
+        glUniform3f(uniform.location, value.x, value.y, value.z);
+    }
+}
+
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const {
+    if (uniform.location >= 0 && changed(uniform.shadow, &value, sizeof(value))) {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+    }
 }
 #endif
\ No newline at end of file
@@ -17,259 +17,352 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "stb_image.h"
 
-
-class Cylinder
+#include "shader.h"
+#include "material.h"
+#include "mesh.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "octree.h"
+#include "lod.h"
+#include "meshgen.h"
+
+// Uniforms of multiLight set on every draw, hashed at compile time
+constexpr UniformName UNIFORM_MODEL("model");
+constexpr UniformName UNIFORM_MATERIAL_INDEX("materialIndex");
+constexpr UniformName UNIFORM_INSTANCED("instanced");
+
+class Shape
 {
     public:
-        
-        // constructor gets height and width of the cylinder along with number of slices
-        Cylinder(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices);
-        
-        // Generate the vertices for the cylinder
-        void generateVertices(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices);
-        
-        // Draw the cylinder
-        void draw();
 
-        // Initialize the OpenGL constructs for this cylinder
-        void init();
+        // Draw the shape with the scene transform applied on top of its own
+        void draw(Shader &shader, const glm::mat4 &parent);
 
+        // Index of the material in the shared MaterialLibrary, looked up on first use
+        int getMaterialIndex();
 
-    private:
-        std::vector<float> vertices;
-        std::vector<int> indices;
-        int vertexSize;
-        int indexSize;
-        unsigned int VBOc, VAOc, EBOc;
+        // Choose this frame's level of detail and point mesh at it; shapes without a LOD chain keep their mesh
+        void selectLod(const glm::mat4 &parent, const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight, LodStats &stats);
+
+        // The finest mesh, which identifies the shape's geometry whatever level it is drawn at
+        Mesh* baseMesh();
+
+        // Box and sphere around the shape in world space; the finest level's bounds cover every level
+        Bounds worldBounds(const glm::mat4 &parent);
+
+        // Shared unit mesh, placed and sized by the model matrix
+        Mesh* mesh;
+        glm::mat4 model;
+        Material material;
+
+        // Levels of detail for mesh, or nullptr for shapes that only have one
+        LodChain* lod = nullptr;
+        int lodLevel = 0;
+
+        // Cleared by frustum culling when the shape is out of view this frame
+        bool visible = true;
+
+        // The shape fills its bounding box, so the box can hide other shapes in software occlusion culling
+        bool occluder = false;
+
+        // The shape's model changes from frame to frame, so ShapeCuller indexes it in an octree instead of a hierarchy
+        bool dynamic = false;
+
+    protected:
+        int materialIndex = -1;
 };
 
-Cylinder::Cylinder(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices) {
-    generateVertices(x, y, z, height, radius, colorR, colorG, colorB, numSlices);
-    init();   
+int Shape::getMaterialIndex() {
+    if (materialIndex < 0) {
+        materialIndex = MaterialLibrary::shared().add(material);
+    }
+    return materialIndex;
 }
 
-void Cylinder::init() {
-    // Generate one vertex array
-    glGenVertexArrays(1, &VAOc);
+void Shape::selectLod(const glm::mat4 &parent, const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight, LodStats &stats) {
+    if (lod != nullptr) {
+        int level = selectLodLevel(*lod, lodLevel, view * parent * model, projection, viewportHeight);
+        if (level != lodLevel) {
+            stats.levelChanges++;
+        }
+        lodLevel = level;
+        mesh = lod->levels[level];
+        stats.trianglesSaved += lod->levels[0]->triangleCount - mesh->triangleCount;
+    }
+    stats.trianglesDrawn += mesh->triangleCount;
+}
 
-    // Generate one vertex, texture and element buffer
-    glGenBuffers(1, &VBOc);
-    glGenBuffers(1, &EBOc);
+Mesh* Shape::baseMesh() {
+    return lod != nullptr ? lod->levels[0] : mesh;
+}
 
-    // Bind the texture
-    glBindVertexArray(VAOc);
+Bounds Shape::worldBounds(const glm::mat4 &parent) {
+    return transformBounds(parent * model, baseMesh()->bounds);
+}
 
-    // Bind the VBO buffer to the GL_ARRAY_BUFFER buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
+// Fill the batch with the world bounds of every shape, in the order given
+void gatherBounds(const std::vector<Shape*> &shapes, const glm::mat4 &parent, BoundsBatch &batch) {
+    batch.resize(shapes.size());
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        batch.models[i] = parent * shapes[i]->model;
+        batch.local[i] = &shapes[i]->baseMesh()->bounds;
+    }
+    batch.transform();
+}
 
-    // **Bind the EBO buffer to ELEMENT_ARRAY_BUFFER object
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
+// Frustum culling for a list of shapes; the buffers are kept from frame to frame
+class ShapeCuller
+{
+    public:
 
-    // Add the triangle vertices to the buffer
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+        // Set every shape's visible flag for the camera given by viewProjection
+        CullStats cull(const std::vector<Shape*> &shapes, const glm::mat4 &parent, const glm::mat4 &viewProjection);
 
-    // **Add the index data to the buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
+        // Index a list of shapes: the static ones in a hierarchy, the dynamic ones in a loose octree.
+        // cull() on the same list then only visits the parts of the scene in view instead of testing
+        // every shape; culling another list drops the index.
+        void index(const std::vector<Shape*> &shapes, const glm::mat4 &parent);
 
-    // Describe where to find the vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0); // position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(3* sizeof(float))); // color
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6* sizeof(float))); // texture
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(8* sizeof(float))); // normals
-    glEnableVertexAttribArray(3);
+        // Move the indexed dynamic shapes to where their models now put them; call once a frame before cull()
+        void update(const glm::mat4 &parent);
 
-}
-void Cylinder::generateVertices(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices) {
-    for(int i=0; i < numSlices; i++) {
-        float theta = (((float)i)*2.0*M_PI) / numSlices;
-        float nextTheta = (((float)i+1.0)*2.0*M_PI) / numSlices;
-        float currX = x + radius*cos(theta);
-        float currY = y + radius*sin(theta);
-        float nextX = x + radius*cos(nextTheta);
-        float nextY = y + radius*sin(nextTheta);
-        glm::vec3 tempVec;
-        vertices.push_back(x);                              // Circle center top - 0
-        vertices.push_back(y);                              // X,Y,Z
-        vertices.push_back(height + z);
-        vertices.push_back(colorR);                         // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(0.5f);                           // Texture Coords
-        vertices.push_back(1.0f);
-        vertices.push_back(0);                              // Normals
-        vertices.push_back(0);
-        vertices.push_back(1);
-
-        vertices.push_back(currX);                          // Outside current top - 1
-        vertices.push_back(currY);
-        vertices.push_back(height + z);
-        vertices.push_back(colorR);                         // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back((1.0f / numSlices) * i);         // Texture Coords
-        vertices.push_back(1.0f);
-        tempVec = normalize(glm::vec3(currX, currY, 0.0));
-        vertices.push_back(tempVec.x);                      // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
-        vertices.push_back(nextX);                          // Outside next top
-        vertices.push_back(nextY);
-        vertices.push_back(height + z);
-        vertices.push_back(colorR);                         // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back((1.0f / numSlices) * (i + 1));   // Texture Coords
-        vertices.push_back(1.0f);
-        tempVec = normalize(glm::vec3(nextX, nextY, 0.0));
-        vertices.push_back(tempVec.x);                      // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
-        vertices.push_back(nextX);                          // Outside next bottom
-        vertices.push_back(nextY);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                         // Colors
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back((1.0f / numSlices) * (i + 1));   // Texture Coords
-        vertices.push_back(0.0f);
-        tempVec = normalize(glm::vec3(nextX, nextY, 0.0));
-        vertices.push_back(tempVec.x);                      // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
-
-        vertices.push_back(currX);                          // Outside current bottom
-        vertices.push_back(currY);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                         // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back((1.0f / numSlices) * (i));       /// Texture Coords
-        vertices.push_back(0.0f);
-        tempVec = normalize(glm::vec3(currX, currY, 0.0));
-        vertices.push_back(tempVec.x);                      // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
-
-        vertices.push_back(x);                              // Center bottom
-        vertices.push_back(y);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                         // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(0.5f);                           // Texture Coords
-        vertices.push_back(1.0f);
-        vertices.push_back(0.0f);                           // Normals
-        vertices.push_back(0.0f);
-        vertices.push_back(-1.0f);
-
-
-        indices.push_back(0 + i * 6);  // Top Triangle
-        indices.push_back(1 + i * 6);
-        indices.push_back(2 + i * 6);
-        
-        indices.push_back(1 + i * 6);  // Side Triangle
-        indices.push_back(4 + i * 6);
-        indices.push_back(2 + i * 6);
-        
-        indices.push_back(2 + i * 6);  // Side Triangle
-        indices.push_back(4 + i * 6);
-        indices.push_back(3 + i * 6);
+        // Recompute the indexed static shapes' bounds after some have moved, keeping the hierarchy's shape
+        void refit(const glm::mat4 &parent);
+
+        // The nearest indexed static shape whose box the ray hits, or nullptr; distance is set to where it enters
+        Shape* pick(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance);
 
-        indices.push_back(4 + i * 6);  // Bottom Triangle
-        indices.push_back(5 + i * 6);
-        indices.push_back(3 + i * 6);
+        // World bounds of the shapes from the last cull
+        BoundsBatch bounds;
+
+        BoundingVolumeHierarchy hierarchy;
+        LooseOctree octree;
+
+    private:
+        std::vector<unsigned char> visible;
+        const std::vector<Shape*>* indexed = nullptr;
+        std::vector<int> found;
+
+        // Static shapes' bounds in hierarchy order, and where each sits in the indexed list
+        BoundsBatch staticBounds;
+        std::vector<Shape*> staticShapes;
+        std::vector<int> staticIndex;
+
+        // Octree handles of the dynamic shapes, and where each sits in the indexed list
+        std::vector<int> dynamicHandles;
+        std::vector<int> dynamicIndex;
+};
+
+CullStats ShapeCuller::cull(const std::vector<Shape*> &shapes, const glm::mat4 &parent, const glm::mat4 &viewProjection) {
+    CullStats stats;
+    stats.total = shapes.size();
+    if (&shapes == indexed && shapes.size() == staticIndex.size() + dynamicIndex.size()) {
+        // The hierarchy returns positions among the static shapes, the octree positions in the list
+        Frustum frustum = extractFrustum(viewProjection);
+        found.clear();
+        hierarchy.queryFrustum(frustum, found);
+        for (int &i : found) {
+            i = staticIndex[i];
+        }
+        octree.queryFrustum(frustum, found);
+        for (Shape* shape : shapes) {
+            shape->visible = false;
+        }
+        for (int i : found) {
+            shapes[i]->visible = true;
+        }
+        stats.visible = found.size();
+        return stats;
     }
-    vertexSize = vertices.size();
-    indexSize = indices.size();
+
+    indexed = nullptr;
+    gatherBounds(shapes, parent, bounds);
+    stats.visible = cullBounds(extractFrustum(viewProjection), bounds, visible);
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        shapes[i]->visible = visible[i] != 0;
+    }
+    return stats;
 }
-void Cylinder::draw() {
-    glBindVertexArray(VAOc);
-    glDrawElements(GL_TRIANGLES, indexSize, GL_UNSIGNED_INT, 0);
+
+void ShapeCuller::index(const std::vector<Shape*> &shapes, const glm::mat4 &parent) {
+    gatherBounds(shapes, parent, bounds);
+    staticShapes.clear();
+    staticIndex.clear();
+    dynamicIndex.clear();
+    dynamicHandles.clear();
+
+    // The octree's root covers everything there is now; dynamic shapes that leave it stay in the root
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        low = glm::min(low, glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]));
+        high = glm::max(high, glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]));
+    }
+    glm::vec3 size = shapes.empty() ? glm::vec3(1.0f) : high - low;
+    octree.reset(shapes.empty() ? glm::vec3(0.0f) : (low + high) * 0.5f, glm::max(size.x, glm::max(size.y, size.z)));
+
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        if (shapes[i]->dynamic) {
+            Bounds box = bounds.get(i);
+            dynamicHandles.push_back(octree.insert(i, box.min, box.max));
+            dynamicIndex.push_back(i);
+        } else {
+            staticShapes.push_back(shapes[i]);
+            staticIndex.push_back(i);
+        }
+    }
+    gatherBounds(staticShapes, parent, staticBounds);
+    hierarchy.build(staticBounds);
+    indexed = &shapes;
 }
 
+void ShapeCuller::update(const glm::mat4 &parent) {
+    if (indexed == nullptr) {
+        return;
+    }
+    for (unsigned int d = 0; d < dynamicIndex.size(); d++) {
+        int i = dynamicIndex[d];
+        Bounds box = (*indexed)[i]->worldBounds(parent);
+        bounds.minX[i] = box.min.x;
+        bounds.minY[i] = box.min.y;
+        bounds.minZ[i] = box.min.z;
+        bounds.maxX[i] = box.max.x;
+        bounds.maxY[i] = box.max.y;
+        bounds.maxZ[i] = box.max.z;
+        bounds.centerX[i] = box.center.x;
+        bounds.centerY[i] = box.center.y;
+        bounds.centerZ[i] = box.center.z;
+        bounds.radius[i] = box.radius;
+        octree.move(dynamicHandles[d], box.min, box.max);
+    }
+}
 
+void ShapeCuller::refit(const glm::mat4 &parent) {
+    if (indexed == nullptr) {
+        return;
+    }
+    gatherBounds(*indexed, parent, bounds);
+    gatherBounds(staticShapes, parent, staticBounds);
+    hierarchy.refit(staticBounds);
+}
 
+Shape* ShapeCuller::pick(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) {
+    if (indexed == nullptr) {
+        return nullptr;
+    }
+    int hit = hierarchy.raycast(origin, direction, maxDistance, distance);
+    return hit >= 0 ? staticShapes[hit] : nullptr;
+}
 
+void Shape::draw(Shader &shader, const glm::mat4 &parent) {
+    shader.setMatrix4fv(UNIFORM_MODEL, parent * model);
+    shader.setInt(UNIFORM_MATERIAL_INDEX, getMaterialIndex());
+    mesh->draw();
+}
 
 
-class Cube
+class Cylinder : public Shape
 {
     public:
         
         // constructor gets height and width of the cylinder along with number of slices
-        Cube(float x, float y, float z, float width, float length, float height, float colorR, float colorG, float colorB);
-        
-        // Generate the vertices for the cube
-        void generateVertices(float x, float y, float z, float width, float length, float height, float colorR, float colorG, float colorB);
+        Cylinder(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices);
         
-        // Draw the cube
-        void draw();
+        // Generate the vertices for a unit cylinder: radius 1, height 1, standing on the origin
+        static void generateVertices(Mesh &mesh, int numSlices, int numSectors);
 
-        // Initialize the OpenGL constructs for this cube
-        void init();
-    private:
-        std::vector<float> vertices;
-        std::vector<int> indices;
-        int vertexSize;
-        int indexSize;
-        unsigned int VBOc, VAOc, EBOc;
+        // Gap between the unit mesh's polygon and a true unit circle, for choosing levels of detail
+        static float tessellationError(int numSlices, int numSectors);
 };
 
-Cube::Cube(float x, float y, float z, float width, float length, float height, float colorR, float colorG, float colorB) {
-    generateVertices(x, y, z, width, length, height, colorR, colorG, colorB);
-    init();   
+Cylinder::Cylinder(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices) {
+    lod = LodCache::shared().acquire(PRIMITIVE_CYLINDER, numSlices, 0, 6, 0, generateVertices, tessellationError);
+    mesh = lod->levels[0];
+    model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z)), glm::vec3(radius, radius, height));
+    material = Material(colorR, colorG, colorB);
+}
+
+float Cylinder::tessellationError(int numSlices, int /*numSectors*/) {
+    // Each side is a chord of the circle; the gap is widest at its middle
+    return 1.0f - cos(M_PI / numSlices);
 }
 
-void Cube::init() {
-    // Generate one vertex array
-    glGenVertexArrays(1, &VAOc);
+void Cylinder::generateVertices(Mesh &mesh, int numSlices, int /*numSectors*/) {
+    mesh.attributes = {3, 0, 2, 3};
+    mesh.preferStrips = true;
+    // Unit dimensions; each object places and sizes the mesh through its model matrix
+    const float height = 1.0f;
+    // The rim polygon lies inside the unit circle, so the true cylinder bounds every tessellation
+    mesh.bounds = boxBounds(glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, height), sqrt(1.0f + 0.25f * height * height));
+    std::vector<float> cosines, sines;
+    circleTable(numSlices, cosines, sines);
+
+    // Six vertices and four triangles per slice, sized up front and written in place
+    mesh.vertices.resize(numSlices * 6 * GENERATED_VERTEX_FLOATS);
+    mesh.indices.resize(numSlices * 12);
+    float* vertex = mesh.vertices.data();
+    int* index = mesh.indices.data();
+    const int sliceIndices[12] = {
+        0, 1, 2,    // Top Triangle
+        1, 4, 2,    // Side Triangle
+        2, 4, 3,    // Side Triangle
+        4, 5, 3     // Bottom Triangle
+    };
+    for(int i=0; i < numSlices; i++) {
+        // On the unit circle each rim position is also its own normal
+        float currX = cosines[i], currY = sines[i];
+        float nextX = cosines[i + 1], nextY = sines[i + 1];
+        float currU = (1.0f / numSlices) * i;
+        float nextU = (1.0f / numSlices) * (i + 1);
+        vertex = writeVertex(vertex, 0.0f, 0.0f, height, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f);           // Circle center top - 0
+        vertex = writeVertex(vertex, currX, currY, height, currU, 1.0f, currX, currY, 0.0f);      // Outside current top - 1
+        vertex = writeVertex(vertex, nextX, nextY, height, nextU, 1.0f, nextX, nextY, 0.0f);      // Outside next top
+        vertex = writeVertex(vertex, nextX, nextY, 0.0f, nextU, 0.0f, nextX, nextY, 0.0f);        // Outside next bottom
+        vertex = writeVertex(vertex, currX, currY, 0.0f, currU, 0.0f, currX, currY, 0.0f);        // Outside current bottom
+        vertex = writeVertex(vertex, 0.0f, 0.0f, 0.0f, 0.5f, 1.0f, 0.0f, 0.0f, -1.0f);            // Center bottom
+
+        for (int k = 0; k < 12; k++) {
+            index[k] = sliceIndices[k] + i * 6;
+        }
+        index += 12;
+    }
+}
 
-    // Generate one vertex and element buffers
-    glGenBuffers(1, &VBOc);
-    glGenBuffers(1, &EBOc);
 
-    glBindVertexArray(VAOc);
 
-    // Bind the VBO buffer to the GL_ARRAY_BUFFER buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
 
-    // **Bind the EBO buffer to ELEMENT_ARRAY_BUFFER object
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
 
-    // Add the triangle vertices to the buffer
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
 
-    // **Add the index data to the buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
+class Cube : public Shape
+{
+    public:
+        
+        // constructor gets the position and the width, length and height of the cube
+        Cube(float x, float y, float z, float width, float length, float height, float colorR, float colorG, float colorB);
+        
+        // Generate the vertices for a unit cube centered over the origin, sitting on z = 0
+        static void generateVertices(Mesh &mesh, int numSlices, int numSectors);
+};
 
-    // Describe where to find the vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0); // position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(3* sizeof(float))); // color
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6* sizeof(float))); // texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(8* sizeof(float))); // normals
-    glEnableVertexAttribArray(3);
+Cube::Cube(float x, float y, float z, float width, float length, float height, float colorR, float colorG, float colorB) {
+    mesh = MeshCache::shared().acquire(PRIMITIVE_CUBE, 0, 0, generateVertices);
+    model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z)), glm::vec3(width, length, height));
+    material = Material(colorR, colorG, colorB);
+    occluder = true;
 }
-void Cube::generateVertices(float x, float y, float z, float width, float length, float height, float colorR, float colorG, float colorB) {
+
+void Cube::generateVertices(Mesh &mesh, int /*numSlices*/, int /*numSectors*/) {
+    mesh.attributes = {3, 0, 2, 3};
+    // Unit dimensions; each object places and sizes the mesh through its model matrix
+    const float x = 0.0f, y = 0.0f, z = 0.0f, width = 1.0f, length = 1.0f, height = 1.0f;
+    std::vector<float> &vertices = mesh.vertices;
     float halfWidth = width / 2.0;
     float halfLength = length / 2.0;
+    mesh.bounds = boxBounds(glm::vec3(x - halfWidth, y - halfLength, z), glm::vec3(x + halfWidth, y + halfLength, z + height), sqrt(halfWidth * halfWidth + halfLength * halfLength + 0.25f * height * height));
 
     // Front - Triangle 1 *********************************************
     vertices.push_back(x - halfWidth);   // Bot left front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);     
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0);
     vertices.push_back(0);
     vertices.push_back(0.0f);
@@ -279,9 +372,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -291,9 +381,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -305,9 +392,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Bot left front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -317,9 +401,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -329,9 +410,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -343,9 +421,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
@@ -355,9 +430,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
@@ -367,9 +439,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
@@ -381,9 +450,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
@@ -393,9 +459,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
@@ -405,9 +468,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
@@ -419,9 +479,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -431,9 +488,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -443,9 +497,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left top
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -457,9 +508,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left top
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -469,9 +517,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left bottom
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -481,9 +526,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -495,9 +537,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Bot left front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(-1.0f);
@@ -507,9 +546,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(-1.0f);
@@ -519,9 +555,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left top
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(-1.0f);
@@ -532,9 +565,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left top
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(-1.0f);
@@ -544,9 +574,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left bottom
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(-1.0f);
@@ -556,9 +583,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Bot left front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(-1.0f);
@@ -569,9 +593,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -581,9 +602,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left top
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -593,9 +611,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -606,9 +621,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -618,9 +630,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Top right front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -630,9 +639,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left front
     vertices.push_back(y - halfLength);
     vertices.push_back(height + z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -644,9 +650,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Bot left front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -656,9 +659,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Top left bottom
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -668,9 +668,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -683,9 +680,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right right side
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
@@ -695,9 +689,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x + halfWidth);   // Bot right front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -707,9 +698,6 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
     vertices.push_back(x - halfWidth);   // Bot left front
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
-    vertices.push_back(colorR);
-    vertices.push_back(colorG);
-    vertices.push_back(colorB);
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
@@ -718,420 +706,216 @@ void Cube::generateVertices(float x, float y, float z, float width, float length
 
 
 
-    indices.insert(indices.end(), {0, 1, 2, 0, 2, 3});  // Front face
-    indices.insert(indices.end(), {1, 2, 4, 4, 2, 5});  // Right face
-    indices.insert(indices.end(), {4, 7, 5, 5, 7, 6});  // Back face
-    indices.insert(indices.end(), {0, 7, 3, 3, 6, 7});  // Left face
-    indices.insert(indices.end(), {3, 2, 6, 6, 2, 5});  // Top face
-    indices.insert(indices.end(), {0, 1, 7, 7, 1, 4});  // Bot face
-    
-    
-    vertexSize = vertices.size();
-    indexSize = indices.size();
-}
-void Cube::draw() {
-    glBindVertexArray(VAOc);
-    glDrawArrays(GL_TRIANGLES, 0, vertexSize);
+    // The faces are written as a plain triangle list; the cache welds them into an indexed mesh
 }
 
 
 
 
-class Cone
+class Cone : public Shape
 {
     public:
         
-        // constructor gets height and width of the cylinder along with number of slices
+        // constructor gets height and radius of the cone along with number of slices
         Cone(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices);
         
-        // Generate the vertices for the cylinder
-        void generateVertices(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices);
-        
-        // Draw the cylinder
-        void draw();
-
-        // Initialize the OpenGL constructs for this cylinder
-        void init();
+        // Generate the vertices for a unit cone: radius 1, height 1, standing on the origin
+        static void generateVertices(Mesh &mesh, int numSlices, int numSectors);
 
-    private:
-        std::vector<float> vertices;
-        std::vector<int> indices;
-        int vertexSize;
-        int indexSize;
-        unsigned int VBOc, VAOc, EBOc;
+        // Gap between the base polygon and a true unit circle; the sides taper so it only shrinks towards the tip
+        static float tessellationError(int numSlices, int numSectors);
 };
 
 Cone::Cone(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices) {
-    generateVertices(x, y, z, height, radius, colorR, colorG, colorB, numSlices);
-    init();   
+    lod = LodCache::shared().acquire(PRIMITIVE_CONE, numSlices, 0, 6, 0, generateVertices, tessellationError);
+    mesh = lod->levels[0];
+    model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z)), glm::vec3(radius, radius, height));
+    material = Material(colorR, colorG, colorB);
 }
 
-void Cone::init() {
-    // Generate one vertex array
-    glGenVertexArrays(1, &VAOc);
-
-    // Generate one vertex, texture and element buffer
-    glGenBuffers(1, &VBOc);
-    glGenBuffers(1, &EBOc);
-
-    // Bind the texture
-    glBindVertexArray(VAOc);
-
-    // Bind the VBO buffer to the GL_ARRAY_BUFFER buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
-
-    // **Bind the EBO buffer to ELEMENT_ARRAY_BUFFER object
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
-
-    // Add the triangle vertices to the buffer
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-
-    // **Add the index data to the buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
-
-    // Describe where to find the vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0); // position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(3* sizeof(float))); // color
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6 * sizeof(float))); // texture
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(8 * sizeof(float))); // normals
-    glEnableVertexAttribArray(3);
+float Cone::tessellationError(int numSlices, int /*numSectors*/) {
+    return 1.0f - cos(M_PI / numSlices);
 }
-void Cone::generateVertices(float x, float y, float z, float height, float radius, float colorR, float colorG, float colorB, int numSlices) {
-    float coneAngle = atan(radius/height);
+
+void Cone::generateVertices(Mesh &mesh, int numSlices, int /*numSectors*/) {
+    mesh.attributes = {3, 0, 2, 3};
+    // Unit dimensions; each object places and sizes the mesh through its model matrix
+    const float height = 1.0f, radius = 1.0f;
+    // Widest at the base rim, which lies inside the unit circle
+    mesh.bounds = boxBounds(glm::vec3(-radius, -radius, 0.0f), glm::vec3(radius, radius, height), sqrt(radius * radius + 0.25f * height * height));
+    std::vector<float> cosines, sines;
+    circleTable(numSlices, cosines, sines);
+
+    // Side normals lean up by the cone angle; every one has the same length before normalizing
+    float normalZ = radius*sin(atan(radius/height));
+    float normalScale = 1.0f / sqrt(1.0f + normalZ * normalZ);
+    float sideZ = normalZ * normalScale;
+
+    // Two triangles, six vertices, per slice, sized up front and written in place
+    mesh.vertices.resize(numSlices * 6 * GENERATED_VERTEX_FLOATS);
+    float* vertex = mesh.vertices.data();
     for(int i=0; i < numSlices; i++) {
-        float theta = (((float)i)*2.0*M_PI) / numSlices;
-        float nextTheta = (((float)i+1)*2.0*M_PI) / numSlices;
-        float currX = x + radius*cos(theta);
-        float currY = y + radius*sin(theta);
-        float nextX = x + radius*cos(nextTheta);
-        float nextY = y + radius*sin(nextTheta);
-        float normalZ = z + radius*sin(coneAngle);
-        glm::vec3 tempVec;
+        float currX = cosines[i], currY = sines[i];
+        float nextX = cosines[i + 1], nextY = sines[i + 1];
+        float currNormalX = currX * normalScale, currNormalY = currY * normalScale;
+        float nextNormalX = nextX * normalScale, nextNormalY = nextY * normalScale;
 
         // Side Triangle *******************************************************************
-        vertices.push_back(x);                                  // Circle center top - 0
-        vertices.push_back(y);
-        vertices.push_back(height + z);
-        vertices.push_back(colorR);                             // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(0.5f);                               // Texture coords
-        vertices.push_back(1.0f);
-        tempVec = glm::normalize(glm::vec3(nextX, nextY, normalZ));
-        vertices.push_back(tempVec.x);                          // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
-
-        vertices.push_back(nextX);                              // Outside next bottom
-        vertices.push_back(nextY);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                             // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(1.0f);                               // Texture coords
-        vertices.push_back(0.0f);
-        tempVec = glm::normalize(glm::vec3(nextX, nextY, normalZ));
-        vertices.push_back(tempVec.x);                          // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
-    
-        vertices.push_back(currX);                              // Outside current bottom
-        vertices.push_back(currY);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                             // Colors
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(0.0f);                               // Texture coords
-        vertices.push_back(0.0f);
-        tempVec = glm::normalize(glm::vec3(currX, currY, normalZ));
-        vertices.push_back(tempVec.x);                          // Normals
-        vertices.push_back(tempVec.y);
-        vertices.push_back(tempVec.z);
-
+        vertex = writeVertex(vertex, 0.0f, 0.0f, height, 0.5f, 1.0f, nextNormalX, nextNormalY, sideZ);   // Circle center top - 0
+        vertex = writeVertex(vertex, nextX, nextY, 0.0f, 1.0f, 0.0f, nextNormalX, nextNormalY, sideZ);   // Outside next bottom
+        vertex = writeVertex(vertex, currX, currY, 0.0f, 0.0f, 0.0f, currNormalX, currNormalY, sideZ);   // Outside current bottom
 
         // Bottom Triangle **********************************************************************
-
-        vertices.push_back(x);                                  // Center bottom
-        vertices.push_back(y);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                             // Colors
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(0.5f);                               // Texture coords
-        vertices.push_back(0.5f);
-        vertices.push_back(0.0f);                               // Normals
-        vertices.push_back(0.0f);
-        vertices.push_back(-1.0f);
-
-        vertices.push_back(nextX);                              // Outside next bottom
-        vertices.push_back(nextY);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                             // Color
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(1.0f);                               // Texture coords
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);                               // Normals
-        vertices.push_back(0.0f);
-        vertices.push_back(-1.0f);
-
-        vertices.push_back(currX);                              // Outside current bottom
-        vertices.push_back(currY);
-        vertices.push_back(z);
-        vertices.push_back(colorR);                             // Colors
-        vertices.push_back(colorG);
-        vertices.push_back(colorB);
-        vertices.push_back(0.0f);                               // Texture coords
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);                               // Normals
-        vertices.push_back(0.0f);
-        vertices.push_back(-1.0f);
-
-        indices.push_back(0 + i * 4);  // Top Triangle
-        indices.push_back(1 + i * 4);
-        indices.push_back(2 + i * 4);
-        
-        indices.push_back(1 + i * 4);  // Bottom Triangle
-        indices.push_back(3 + i * 4);
-        indices.push_back(2 + i * 4);
+        vertex = writeVertex(vertex, 0.0f, 0.0f, 0.0f, 0.5f, 0.5f, 0.0f, 0.0f, -1.0f);     // Center bottom
+        vertex = writeVertex(vertex, nextX, nextY, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, -1.0f);   // Outside next bottom
+        vertex = writeVertex(vertex, currX, currY, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f);   // Outside current bottom
     }
-    vertexSize = vertices.size();
-    indexSize = indices.size();
-}
-void Cone::draw() {
-    glBindVertexArray(VAOc);
-    glDrawArrays(GL_TRIANGLES, 0, vertexSize);
+    // The triangles are written as a plain list; the cache welds them into an indexed mesh
 }
 
 
-class Plane
+class Plane : public Shape
 {
     public:
         
         // constructor gets height and width of the plane
         Plane(float x, float y, float z, float width, float length, float colorR, float colorG, float colorB);
         
-        // Generate the vertices for the plane
-        void generateVertices(float x, float y, float z, float width, float length, float colorR, float colorG, float colorB);
-        
-        // Draw the plane
-        void draw();
-
-        // Initialize the OpenGL constructs for this plane
-        void init();
-
-        void loadTexture();
-    private:
-        std::vector<float> vertices;
-        std::vector<int> indices;
-        int vertexSize;
-        int indexSize;
-        unsigned int VBOc, VAOc, EBOc;
+        // Generate the vertices for a unit plane centered on the origin
+        static void generateVertices(Mesh &mesh, int numSlices, int numSectors);
 };
 
 Plane::Plane(float x, float y, float z, float width, float length, float colorR, float colorG, float colorB) {
-    generateVertices(x, y, z, width, length, colorR, colorG, colorB);
-    init();   
+    mesh = MeshCache::shared().acquire(PRIMITIVE_PLANE, 0, 0, generateVertices);
+    model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z)), glm::vec3(width, length, 1.0f));
+    material = Material(colorR, colorG, colorB);
+    occluder = true;
 }
 
-void Plane::init() {
-    // Generate one vertex array
-    glGenVertexArrays(1, &VAOc);
-
-    // Generate one vertex, texture and element buffer
-    glGenBuffers(1, &VBOc);
-    glGenBuffers(1, &EBOc);
-
-    // Bind the texture
-    glBindVertexArray(VAOc);
-
-    // Bind the VBO buffer to the GL_ARRAY_BUFFER buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
-
-    // **Bind the EBO buffer to ELEMENT_ARRAY_BUFFER object
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
-
-    // Add the triangle vertices to the buffer
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-
-    // **Add the index data to the buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
-
-    // Describe where to find the vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0); // position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3* sizeof(float))); // color
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float))); // texture
-    glEnableVertexAttribArray(2);
-
-}
-void Plane::generateVertices(float x, float y, float z, float width, float length, float colorR, float colorG, float colorB) {
+void Plane::generateVertices(Mesh &mesh, int /*numSlices*/, int /*numSectors*/) {
+    mesh.attributes = {3, 0, 2, 3};
+    // Unit dimensions; each object places and sizes the mesh through its model matrix
+    const float x = 0.0f, y = 0.0f, z = 0.0f, width = 1.0f, length = 1.0f;
+    std::vector<float> &vertices = mesh.vertices;
+    std::vector<int> &indices = mesh.indices;
     float halfWidth = width / 2.0;
     float halfLength = length / 2.0;
+    mesh.bounds = boxBounds(glm::vec3(x - halfWidth, y - halfLength, z), glm::vec3(x + halfWidth, y + halfLength, z), sqrt(halfWidth * halfWidth + halfLength * halfLength));
     vertices.push_back(x - halfWidth);   // Bot left
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
 
-    vertices.insert(vertices.end(), {colorR, colorG, colorB});
 
     vertices.push_back(0.0f);
     vertices.push_back(0.0f);
+    vertices.insert(vertices.end(), {0.0f, 0.0f, 1.0f});  // Normal
     
     vertices.push_back(x - halfWidth);   // Top left
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
 
-    vertices.insert(vertices.end(), {colorR, colorG, colorB});
 
     vertices.push_back(0.0f);
     vertices.push_back(1.0f);
+    vertices.insert(vertices.end(), {0.0f, 0.0f, 1.0f});  // Normal
 
     vertices.push_back(x + halfWidth);   // Top right
     vertices.push_back(y + halfLength);
     vertices.push_back(z);
 
-    vertices.insert(vertices.end(), {colorR, colorG, colorB});
 
     vertices.push_back(1.0f);
     vertices.push_back(1.0f);
+    vertices.insert(vertices.end(), {0.0f, 0.0f, 1.0f});  // Normal
 
     vertices.push_back(x + halfWidth);   // Bot Right
     vertices.push_back(y - halfLength);
     vertices.push_back(z);
 
-    vertices.insert(vertices.end(), {colorR, colorG, colorB});
 
     vertices.push_back(1.0f);
     vertices.push_back(0.0f);
+    vertices.insert(vertices.end(), {0.0f, 0.0f, 1.0f});  // Normal
 
     indices.insert(indices.end(), {0, 1, 2, 2, 0, 3});  // Plane
     
     
-    vertexSize = vertices.size();
-    indexSize = indices.size();
-}
-void Plane::draw() {
-    glBindVertexArray(VAOc);
-    glDrawElements(GL_TRIANGLES, indexSize, GL_UNSIGNED_INT, 0);
 }
 
 
-class Sphere
+class Sphere : public Shape
 {
     public:
         
-        // constructor gets height and width of the cylinder along with number of slices
+        // constructor gets the position and radius of the sphere along with number of stacks and sectors
         Sphere(float x, float y, float z, float radius, float colorR, float colorG, float colorB, int numSlices, int numSectors);
         
-        // Generate the vertices for the cylinder
-        void generateVertices(float x, float y, float z, float radius, float colorR, float colorG, float colorB, int numSlices, int numSectors);
-        
-        // Draw the cylinder
-        void draw();
+        // Generate the vertices for a unit sphere centered on the origin
+        static void generateVertices(Mesh &mesh, int numSlices, int numSectors);
 
-        // Initialize the OpenGL constructs for this cylinder
-        void init();
-    private:
-        std::vector<float> vertices;
-        std::vector<int> indices;
-        int vertexSize;
-        int indexSize;
-        unsigned int VBOc, VAOc, EBOc;
+        // Gap between the unit mesh and a true unit sphere, set by the wider of the stack and sector steps
+        static float tessellationError(int numSlices, int numSectors);
 };
 
 Sphere::Sphere(float x, float y, float z, float radius, float colorR, float colorG, float colorB, int numSlices, int numSectors) {
-    generateVertices(x, y, z, radius, colorR, colorG, colorB, numSlices, numSectors);
-    init();   
+    lod = LodCache::shared().acquire(PRIMITIVE_SPHERE, numSlices, numSectors, 3, 6, generateVertices, tessellationError);
+    mesh = lod->levels[0];
+    model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z)), glm::vec3(radius));
+    material = Material(colorR, colorG, colorB);
 }
 
-void Sphere::init() {
-    // Generate one vertex array
-    glGenVertexArrays(1, &VAOc);
-
-    // Generate one vertex and element buffers
-    glGenBuffers(1, &VBOc);
-    glGenBuffers(1, &EBOc);
-
-    glBindVertexArray(VAOc);
-
-    // Bind the VBO buffer to the GL_ARRAY_BUFFER buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, VBOc);
-
-    // **Bind the EBO buffer to ELEMENT_ARRAY_BUFFER object
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOc);
-
-    // Add the triangle vertices to the buffer
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-
-    // **Add the index data to the buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
+float Sphere::tessellationError(int numSlices, int numSectors) {
+    // Stacks step pi / numSlices, sectors step 2 pi / numSectors; the gap is widest halfway along a step
+    float halfStep = std::max(M_PI / (2 * numSlices), M_PI / numSectors);
+    return 1.0f - cos(halfStep);
+}
 
-    // Describe where to find the vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0); // position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3* sizeof(float))); // color
-    glEnableVertexAttribArray(1);
+void Sphere::generateVertices(Mesh &mesh, int numSlices, int numSectors) {
+    mesh.attributes = {3, 0, 2, 3};
+    mesh.preferStrips = true;
+    // Unit radius; each object places and sizes the mesh through its model matrix
+    mesh.bounds = boxBounds(glm::vec3(-1.0f), glm::vec3(1.0f), 1.0f);
+    std::vector<float> sectorCos, sectorSin;
+    circleTable(numSectors, sectorCos, sectorSin);
+    std::vector<float> stackCos(numSlices + 1), stackSin(numSlices + 1);
+    angleTable(numSlices + 1, M_PI / 2.0, -M_PI / numSlices, stackCos.data(), stackSin.data());
+
+    // One ring of vertices per stack, from the north pole down; the first and last
+    // vertex of each ring share a position but not a texture coordinate
+    mesh.vertices.resize((numSlices + 1) * (numSectors + 1) * GENERATED_VERTEX_FLOATS);
+    float* vertex = mesh.vertices.data();
+    for(int i=0; i <= numSlices; i++) {
+        float xy = stackCos[i];             // cos(u)
+        float zt = stackSin[i];
+        float v = 1.0f - (float)i / numSlices;
+        for(int j=0; j <= numSectors; j++) {
+            float xt = xy * sectorCos[j];   // cos(u) * cos(v)
+            float yt = xy * sectorSin[j];
+            // On the unit sphere the position is also the normal
+            vertex = writeVertex(vertex, xt, yt, zt, (float)j / numSectors, v, xt, yt, zt);
+        }
+    }
 
-}
-void Sphere::generateVertices(float x, float y, float z, float radius, float colorR, float colorG, float colorB, int numSlices, int numSectors) {
-    float sectorStep = 2 * M_PI / numSectors;
-    float stackStep = M_PI / numSlices;
-    float xy, zt, xyNext, ztNext, xt, yt;
+    // Two triangles per square, skipping the ones that collapse at the poles
+    mesh.indices.resize(numSlices > 0 ? 6 * numSectors * (numSlices - 1) : 0);
+    int* index = mesh.indices.data();
     for(int i=0; i < numSlices; i++) {
-        float phi = M_PI / 2.0f - i * stackStep;
-        float nextPhi = M_PI / 2.0f - (i + 1) * stackStep;
-        xy = radius * cosf(phi);             // r * cos(u)
-        zt = radius * sinf(phi);
-        xyNext = radius * cosf(nextPhi);
-        ztNext = radius * sinf(nextPhi);
+        int ring = i * (numSectors + 1);
+        int nextRing = ring + numSectors + 1;
         for(int j=0; j < numSectors; j++) {
-            float theta = j * sectorStep;
-            float nextTheta = (j + 1) * sectorStep;
-
-            xt = xy * cosf(theta);             // r * cos(u) * cos(v)
-            yt = xy * sinf(theta);
-            vertices.push_back(xy * cosf(theta));     // Bot left of this Square - 0
-            vertices.push_back(xy * sinf(theta));
-            vertices.push_back(zt);
-            vertices.insert(vertices.end(), {colorR, colorG, colorB});
-
-            vertices.push_back(xyNext * cosf(nextTheta)); // Bot right of this Square - 1
-            vertices.push_back(xyNext * sinf(nextTheta));
-            vertices.push_back(zt);
-            vertices.insert(vertices.end(), {colorR, colorG, colorB});
-
-            vertices.push_back(xyNext * cosf(theta));       // Top left of this square - 2
-            vertices.push_back(xyNext * sinf(theta));
-            vertices.push_back(ztNext);
-            vertices.insert(vertices.end(), {colorR, colorG, colorB});
-
-            vertices.push_back(xyNext * cosf(nextTheta));   // Top right of this square 3
-            vertices.push_back(xyNext * sinf(nextTheta));
-            vertices.push_back(ztNext);
-            vertices.insert(vertices.end(), {colorR, colorG, colorB});
-
-            vertices.push_back(xyNext * cosf(nextTheta)); // Bot right of this Square - 1
-            vertices.push_back(xyNext * sinf(nextTheta));
-            vertices.push_back(zt);
-            vertices.insert(vertices.end(), {colorR, colorG, colorB});
-
-            vertices.push_back(xyNext * cosf(theta));       // Top left of this square - 2
-            vertices.push_back(xyNext * sinf(theta));
-            vertices.push_back(ztNext);
-            vertices.insert(vertices.end(), {colorR, colorG, colorB});
+            if (i != 0) {
+                index[0] = ring + j;
+                index[1] = nextRing + j;
+                index[2] = ring + j + 1;
+                index += 3;
+            }
+            if (i != numSlices - 1) {
+                index[0] = ring + j + 1;
+                index[1] = nextRing + j;
+                index[2] = nextRing + j + 1;
+                index += 3;
+            }
         }
     }
-    vertexSize = vertices.size();
-    indexSize = indices.size();
-}
-void Sphere::draw() {
-    glBindVertexArray(VAOc);
-    glDrawArrays(GL_TRIANGLES, 0, vertexSize);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE is part of every x86-64 target, so only 32-bit builds without it fall back to scalar code
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define USE_SSE
+#endif
+#endif
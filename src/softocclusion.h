@@ -0,0 +1,323 @@
+#ifndef SOFTOCCLUSION_H
+#define SOFTOCCLUSION_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "shapes.h"
+#include "simd.h"
+#include "workerpool.h"
+
+// Pixels per tile of the hierarchical buffer, and rows per band handed to one worker.
+// A band is a whole number of tile rows, so every tile belongs to one band.
+const int SOFTWARE_OCCLUSION_TILE_WIDTH = 8;
+const int SOFTWARE_OCCLUSION_TILE_HEIGHT = 8;
+const int SOFTWARE_OCCLUSION_BAND_HEIGHT = 16;
+
+// What the software occlusion pass did in one frame
+struct SoftwareOcclusionStats
+{
+    int occluders;      // shapes drawn into the depth buffer
+    int tested;         // visible shapes tested against it
+    int rejected;       // of those, found hidden and marked not visible
+    float milliseconds; // time spent in cull(), rasterizing and testing
+};
+
+// One face of an occluder box in screen space, rasterized as a convex quad.
+// An edge is a * x + b * y + c, positive inside.
+struct OcclusionQuad
+{
+    float a[4], b[4], c[4];
+    float depthX, depthY, depthBase;  // depth = depthBase + depthX * x + depthY * y
+    int minX, maxX, minY, maxY;
+};
+
+// Occlusion culling without the GPU. The boxes of shapes marked as occluders are rasterized at
+// low resolution into a depth buffer, keeping the nearest depth per pixel, and the farthest depth
+// of each tile is kept on top of it. A visible shape is rejected when every pixel its screen
+// rectangle touches holds something nearer than the nearest corner of its box.
+//
+// The occluder side is conservative too: only pixels a face covers entirely are written, with
+// the face's farthest depth inside the pixel, so a low resolution never hides more than the real
+// geometry would. Occluders use their box in their own space, so they should be shapes that fill
+// their box, such as Cube and Plane.
+class SoftwareOcclusion
+{
+    public:
+
+        // constructor gets the depth buffer size in pixels; the width is rounded up to a multiple of 4
+        SoftwareOcclusion(int width = 256, int height = 192);
+
+        // Rasterize the visible occluders among shapes, then clear visible on every shape found hidden.
+        // bounds holds the shapes' world bounds in the same order, as ShapeCuller leaves them.
+        SoftwareOcclusionStats cull(std::vector<Shape*> &shapes, const BoundsBatch &bounds, const glm::mat4 &parent, const glm::mat4 &viewProjection);
+
+        // Nearest depth of each pixel from the last cull(), between 0 at the near plane and 1 at the far one
+        std::vector<float> depth;
+        int width, height;
+
+    private:
+        std::vector<float> tileMax;
+        int tilesX, tilesY;
+        std::vector<OcclusionQuad> quads;
+
+        // Project the six faces of a shape's box; false if a corner is behind the eye
+        bool addOccluder(const glm::mat4 &modelViewProjection, const Bounds &local);
+        void addFace(const glm::vec3 corners[8], int i0, int i1, int i2, int i3);
+
+        // Clear, rasterize and build the tile maxima for rows [firstRow, lastRow)
+        void rasterizeBand(int firstRow, int lastRow);
+
+        // True if everything in the pixel rectangle is nearer than nearest
+        bool hidden(int minX, int maxX, int minY, int maxY, float nearest);
+};
+
+SoftwareOcclusion::SoftwareOcclusion(int bufferWidth, int bufferHeight) {
+    width = (bufferWidth + 3) & ~3;
+    height = bufferHeight;
+    tilesX = (width + SOFTWARE_OCCLUSION_TILE_WIDTH - 1) / SOFTWARE_OCCLUSION_TILE_WIDTH;
+    tilesY = (height + SOFTWARE_OCCLUSION_TILE_HEIGHT - 1) / SOFTWARE_OCCLUSION_TILE_HEIGHT;
+    depth.resize(width * height);
+    tileMax.resize(tilesX * tilesY);
+}
+
+bool SoftwareOcclusion::addOccluder(const glm::mat4 &modelViewProjection, const Bounds &local) {
+    // Corner i takes max on x when bit 0 is set, on y for bit 1 and on z for bit 2
+    glm::vec3 corners[8];
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 corner((i & 1) ? local.max.x : local.min.x, (i & 2) ? local.max.y : local.min.y, (i & 4) ? local.max.z : local.min.z, 1.0f);
+        glm::vec4 clip = modelViewProjection * corner;
+        // Clipping against the near plane is not done; skipping the occluder only costs culling
+        if (clip.w < 1e-4f) {
+            return false;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        corners[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+    addFace(corners, 0, 1, 3, 2);
+    addFace(corners, 4, 5, 7, 6);
+    addFace(corners, 0, 1, 5, 4);
+    addFace(corners, 2, 3, 7, 6);
+    addFace(corners, 0, 2, 6, 4);
+    addFace(corners, 1, 3, 7, 5);
+    return true;
+}
+
+void SoftwareOcclusion::addFace(const glm::vec3 corners[8], int i0, int i1, int i2, int i3) {
+    const glm::vec3* v[4] = {&corners[i0], &corners[i1], &corners[i2], &corners[i3]};
+
+    // Twice the signed area; faces seen edge on cover nothing
+    float area = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        const glm::vec3 &p = *v[i];
+        const glm::vec3 &q = *v[(i + 1) % 4];
+        area += p.x * q.y - q.x * p.y;
+    }
+    if (std::fabs(area) < 1e-3f) {
+        return;
+    }
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+
+    OcclusionQuad quad;
+    float lowX = v[0]->x, highX = v[0]->x, lowY = v[0]->y, highY = v[0]->y;
+    for (int i = 0; i < 4; i++) {
+        const glm::vec3 &p = *v[i];
+        const glm::vec3 &q = *v[(i + 1) % 4];
+        quad.a[i] = -(q.y - p.y) * sign;
+        quad.b[i] = (q.x - p.x) * sign;
+        quad.c[i] = -(quad.a[i] * p.x + quad.b[i] * p.y);
+        lowX = std::min(lowX, p.x);
+        highX = std::max(highX, p.x);
+        lowY = std::min(lowY, p.y);
+        highY = std::max(highY, p.y);
+    }
+
+    // The face is flat, so its depth is a plane; take it from the larger of its two triangles for precision
+    glm::vec3 first1 = *v[1] - *v[0], first2 = *v[2] - *v[0];
+    glm::vec3 second1 = *v[2] - *v[0], second2 = *v[3] - *v[0];
+    float firstArea = first1.x * first2.y - first2.x * first1.y;
+    float secondArea = second1.x * second2.y - second2.x * second1.y;
+    bool useFirst = std::fabs(firstArea) >= std::fabs(secondArea);
+    glm::vec3 d1 = useFirst ? first1 : second1;
+    glm::vec3 d2 = useFirst ? first2 : second2;
+    float determinant = useFirst ? firstArea : secondArea;
+    if (std::fabs(determinant) < 1e-6f) {
+        return;
+    }
+    quad.depthX = (d1.z * d2.y - d2.z * d1.y) / determinant;
+    quad.depthY = (d2.z * d1.x - d1.z * d2.x) / determinant;
+    quad.depthBase = v[0]->z - quad.depthX * v[0]->x - quad.depthY * v[0]->y;
+
+    quad.minX = std::max(0, (int)std::floor(lowX)) & ~3;
+    quad.maxX = std::min(width - 1, (int)std::ceil(highX));
+    quad.minY = std::max(0, (int)std::floor(lowY));
+    quad.maxY = std::min(height - 1, (int)std::ceil(highY));
+    if (quad.minX <= quad.maxX && quad.minY <= quad.maxY) {
+        quads.push_back(quad);
+    }
+}
+
+void SoftwareOcclusion::rasterizeBand(int firstRow, int lastRow) {
+    std::fill(depth.begin() + firstRow * width, depth.begin() + lastRow * width, 1.0f);
+
+    for (const OcclusionQuad &quad : quads) {
+        if (quad.maxY < firstRow || quad.minY >= lastRow) {
+            continue;
+        }
+        // A pixel is covered entirely when its center is half a pixel inside every edge, and
+        // the farthest depth within it is half a pixel further along the depth slopes
+        float inset[4];
+        for (int e = 0; e < 4; e++) {
+            inset[e] = 0.5f * (std::fabs(quad.a[e]) + std::fabs(quad.b[e]));
+        }
+        float depthBias = 0.5f * (std::fabs(quad.depthX) + std::fabs(quad.depthY));
+
+        for (int y = std::max(firstRow, quad.minY); y <= std::min(lastRow - 1, quad.maxY); y++) {
+            float centerY = y + 0.5f;
+            float* row = &depth[y * width];
+            int x = quad.minX;
+#ifdef USE_SSE
+            const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 rowEdge[4], stepA[4], limit[4];
+            for (int e = 0; e < 4; e++) {
+                rowEdge[e] = _mm_set1_ps(quad.b[e] * centerY + quad.c[e]);
+                stepA[e] = _mm_set1_ps(quad.a[e]);
+                limit[e] = _mm_set1_ps(inset[e]);
+            }
+            __m128 rowDepth = _mm_set1_ps(quad.depthBase + quad.depthY * centerY + depthBias);
+            __m128 slope = _mm_set1_ps(quad.depthX);
+            for (; x + 4 <= quad.maxX + 1; x += 4) {
+                __m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepA[0], centerX), rowEdge[0]), limit[0]);
+                for (int e = 1; e < 4; e++) {
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepA[e], centerX), rowEdge[e]), limit[e]));
+                }
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, _mm_add_ps(rowDepth, _mm_mul_ps(slope, centerX)));
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+#endif
+            for (; x <= quad.maxX; x++) {
+                float centerX = x + 0.5f;
+                bool inside = true;
+                for (int e = 0; e < 4; e++) {
+                    inside = inside && quad.a[e] * centerX + quad.b[e] * centerY + quad.c[e] >= inset[e];
+                }
+                if (inside) {
+                    row[x] = std::min(row[x], quad.depthBase + quad.depthX * centerX + quad.depthY * centerY + depthBias);
+                }
+            }
+        }
+    }
+
+    // The farthest depth of each tile in the band, for a quick test before looking at pixels
+    for (int tileY = firstRow / SOFTWARE_OCCLUSION_TILE_HEIGHT; tileY * SOFTWARE_OCCLUSION_TILE_HEIGHT < lastRow; tileY++) {
+        for (int tileX = 0; tileX < tilesX; tileX++) {
+            float farthest = 0.0f;
+            for (int y = tileY * SOFTWARE_OCCLUSION_TILE_HEIGHT; y < std::min(height, (tileY + 1) * SOFTWARE_OCCLUSION_TILE_HEIGHT); y++) {
+                for (int x = tileX * SOFTWARE_OCCLUSION_TILE_WIDTH; x < std::min(width, (tileX + 1) * SOFTWARE_OCCLUSION_TILE_WIDTH); x++) {
+                    farthest = std::max(farthest, depth[y * width + x]);
+                }
+            }
+            tileMax[tileY * tilesX + tileX] = farthest;
+        }
+    }
+}
+
+bool SoftwareOcclusion::hidden(int minX, int maxX, int minY, int maxY, float nearest) {
+    for (int tileY = minY / SOFTWARE_OCCLUSION_TILE_HEIGHT; tileY <= maxY / SOFTWARE_OCCLUSION_TILE_HEIGHT; tileY++) {
+        for (int tileX = minX / SOFTWARE_OCCLUSION_TILE_WIDTH; tileX <= maxX / SOFTWARE_OCCLUSION_TILE_WIDTH; tileX++) {
+            if (tileMax[tileY * tilesX + tileX] < nearest) {
+                continue;   // everything in the tile is in front
+            }
+            // Look at the pixels of the tile that the rectangle covers
+            int x0 = std::max(minX, tileX * SOFTWARE_OCCLUSION_TILE_WIDTH);
+            int x1 = std::min(maxX, (tileX + 1) * SOFTWARE_OCCLUSION_TILE_WIDTH - 1);
+            int y0 = std::max(minY, tileY * SOFTWARE_OCCLUSION_TILE_HEIGHT);
+            int y1 = std::min(maxY, (tileY + 1) * SOFTWARE_OCCLUSION_TILE_HEIGHT - 1);
+            for (int y = y0; y <= y1; y++) {
+                const float* row = &depth[y * width];
+                int x = x0;
+#ifdef USE_SSE
+                const __m128 limit = _mm_set1_ps(nearest);
+                for (; x + 4 <= x1 + 1; x += 4) {
+                    if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), limit)) != 0) {
+                        return false;
+                    }
+                }
+#endif
+                for (; x <= x1; x++) {
+                    if (row[x] >= nearest) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+SoftwareOcclusionStats SoftwareOcclusion::cull(std::vector<Shape*> &shapes, const BoundsBatch &bounds, const glm::mat4 &parent, const glm::mat4 &viewProjection) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SoftwareOcclusionStats stats = {0, 0, 0, 0.0f};
+
+    quads.clear();
+    for (Shape* shape : shapes) {
+        if (shape->visible && shape->occluder && addOccluder(viewProjection * parent * shape->model, shape->baseMesh()->bounds)) {
+            stats.occluders++;
+        }
+    }
+
+    // Each band owns its rows of the buffer and of the tile maxima, so the workers never share a pixel
+    int bands = (height + SOFTWARE_OCCLUSION_BAND_HEIGHT - 1) / SOFTWARE_OCCLUSION_BAND_HEIGHT;
+    WorkerPool::shared().parallelFor(bands, [this](int band) {
+        rasterizeBand(band * SOFTWARE_OCCLUSION_BAND_HEIGHT, std::min(height, (band + 1) * SOFTWARE_OCCLUSION_BAND_HEIGHT));
+    });
+
+    for (unsigned int i = 0; i < shapes.size(); i++) {
+        if (!shapes[i]->visible) {
+            continue;
+        }
+        Bounds world = bounds.get(i);
+        float lowX = width, highX = 0.0f, lowY = height, highY = 0.0f, nearest = 1.0f;
+        bool inFront = true;
+        for (int c = 0; c < 8 && inFront; c++) {
+            glm::vec4 clip = viewProjection * glm::vec4((c & 1) ? world.max.x : world.min.x, (c & 2) ? world.max.y : world.min.y, (c & 4) ? world.max.z : world.min.z, 1.0f);
+            inFront = clip.w > 1e-4f;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            lowX = std::min(lowX, (ndc.x * 0.5f + 0.5f) * width);
+            highX = std::max(highX, (ndc.x * 0.5f + 0.5f) * width);
+            lowY = std::min(lowY, (ndc.y * 0.5f + 0.5f) * height);
+            highY = std::max(highY, (ndc.y * 0.5f + 0.5f) * height);
+            nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+        // A box reaching behind the eye can cover anything; keep it
+        if (!inFront) {
+            continue;
+        }
+        int minX = std::max(0, (int)std::floor(lowX));
+        int maxX = std::min(width - 1, (int)std::floor(highX));
+        int minY = std::max(0, (int)std::floor(lowY));
+        int maxY = std::min(height - 1, (int)std::floor(highY));
+        if (minX > maxX || minY > maxY) {
+            continue;
+        }
+        stats.tested++;
+        if (hidden(minX, maxX, minY, maxY, nearest)) {
+            shapes[i]->visible = false;
+            stats.rejected++;
+        }
+    }
+
+    stats.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// How vertices are stored in GPU memory
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,    // interleaved floats, one per attribute component
+    VERTEX_FORMAT_COMPACT   // CompactVertex: 16 bytes
+};
+
+// Quantized vertex, decoded by multiLight.vs when compactVertices is set
+struct CompactVertex
+{
+    glm::uint64 position;   // half float x, y, z, 1
+    glm::uint32 normal;     // octahedral encoded, two snorm16
+    glm::uint32 texCoords;  // two unorm16
+};
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay 16 bytes");
+
+// Fold a unit vector onto the octahedron and unwrap the lower half, giving two values in [-1, 1]
+glm::vec2 octahedralEncode(glm::vec3 normal) {
+    float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (sum == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 encoded = glm::vec2(normal.x, normal.y) / sum;
+    if (normal.z < 0.0f) {
+        glm::vec2 sign(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+        encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+    }
+    return encoded;
+}
+
+// Pack float vertices laid out as position, texture coords, normal ({3, 0, 2, 3})
+std::vector<CompactVertex> packCompactVertices(const std::vector<float> &vertices) {
+    const int stride = 8;
+    std::vector<CompactVertex> packed(vertices.size() / stride);
+    for (unsigned int v = 0; v < packed.size(); v++) {
+        const float* vertex = &vertices[v * stride];
+        packed[v].position = glm::packHalf4x16(glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+        packed[v].texCoords = glm::packUnorm2x16(glm::vec2(vertex[3], vertex[4]));
+        packed[v].normal = glm::packSnorm2x16(octahedralEncode(glm::vec3(vertex[5], vertex[6], vertex[7])));
+    }
+    return packed;
+}
+
+// Bytes per vertex in GPU memory
+int vertexFormatSize(VertexFormat format, const std::vector<int> &attributes) {
+    if (format == VERTEX_FORMAT_COMPACT) {
+        return sizeof(CompactVertex);
+    }
+    int floats = 0;
+    for (int size : attributes) {
+        floats += size;
+    }
+    return floats * sizeof(float);
+}
+
+// Describe the vertex attributes of the currently bound VAO and GL_ARRAY_BUFFER.
+// Both formats use the same locations, so one shader reads either. An attribute of
+// size 0 is not stored and its location is left disabled.
+void bindVertexFormat(VertexFormat format, const std::vector<int> &attributes) {
+    if (format == VERTEX_FORMAT_COMPACT) {
+        glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position)); // position
+        glEnableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords)); // texture
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal)); // octahedral normal
+        glEnableVertexAttribArray(3);
+        return;
+    }
+
+    int stride = vertexFormatSize(format, attributes);
+    int offset = 0;
+    for (unsigned int i = 0; i < attributes.size(); i++) {
+        if (attributes[i] == 0) {
+            glDisableVertexAttribArray(i);
+            continue;
+        }
+        glVertexAttribPointer(i, attributes[i], GL_FLOAT, GL_FALSE, stride, (void*)(offset * sizeof(float)));
+        glEnableVertexAttribArray(i);
+        offset += attributes[i];
+    }
+}
+#endif
@@ -0,0 +1,134 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for CPU work such as mesh generation.
+// The thread that calls parallelFor works too, so one worker is started per core but one.
+// parallelFor is meant to be called from one thread at a time.
+class WorkerPool
+{
+    public:
+
+        // The pool shared by the whole program
+        static WorkerPool& shared();
+
+        // constructor gets the number of worker threads; 0 starts one per core but one
+        WorkerPool(int threadCount = 0);
+        ~WorkerPool();
+
+        // Run body(0) to body(count - 1) spread over the workers and return once every call has finished
+        void parallelFor(int count, const std::function<void(int)> &body);
+
+        // Number of threads that run jobs, counting the caller
+        int size();
+
+    private:
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        // The running job; generation changes every time a new one starts
+        const std::function<void(int)>* job;
+        int jobCount;
+        std::atomic<int> next;
+        int busy;
+        int generation;
+        bool stopping;
+
+        void work();
+        void runJob();
+};
+
+WorkerPool& WorkerPool::shared() {
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::WorkerPool(int threadCount) {
+    job = nullptr;
+    jobCount = 0;
+    next = 0;
+    busy = 0;
+    generation = 0;
+    stopping = false;
+    if (threadCount <= 0) {
+        threadCount = (int)std::thread::hardware_concurrency() - 1;
+    }
+    for (int i = 0; i < threadCount; i++) {
+        threads.push_back(std::thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::parallelFor(int count, const std::function<void(int)> &body) {
+    if (threads.empty() || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &body;
+        jobCount = count;
+        next = 0;
+        busy = threads.size();
+        generation++;
+    }
+    wake.notify_all();
+    runJob();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+}
+
+int WorkerPool::size() {
+    return threads.size() + 1;
+}
+
+void WorkerPool::work() {
+    int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        runJob();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+        }
+        done.notify_one();
+    }
+}
+
+void WorkerPool::runJob() {
+    // Each index is claimed by exactly one thread
+    for (int i = next++; i < jobCount; i = next++) {
+        (*job)(i);
+    }
+}
+#endif